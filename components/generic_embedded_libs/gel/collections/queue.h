@@ -78,4 +78,139 @@ typedef enum {
         return elements_in == capacity;                                                                                \
     }
 
+/*
+ *  Single producer, single consumer variant, safe to share between two tasks (or a task and an interrupt) without
+ * locking. Only one context may ever enqueue and only one may ever dequeue. Each index is written by one side only
+ * and published with release semantics, so the item is complete before the other side sees it.
+ * NUM_ITEMS must be a power of 2.
+ *
+ * On top of the usual copying functions:
+ * - NAME##_reserve/NAME##_commit let the producer build an item in place;
+ * - NAME##_peek/NAME##_release let the consumer read an item in place;
+ * - NAME##_enqueue_batch/NAME##_dequeue_batch move several items with a single index update.
+ */
+#define SPSC_QUEUE_DECLARATION(NAME, ITEM_TYPE, NUM_ITEMS)                                                             \
+    _Static_assert(((NUM_ITEMS) & ((NUM_ITEMS)-1)) == 0, "SPSC queue size must be a power of 2");                      \
+    struct NAME {                                                                                                      \
+        uint32_t  read_idx;                                                                                            \
+        uint32_t  write_idx;                                                                                           \
+        ITEM_TYPE items[NUM_ITEMS];                                                                                    \
+    };                                                                                                                 \
+    void             NAME##_init(struct NAME *p_queue);                                                                \
+    enqueue_result_t NAME##_enqueue(struct NAME *p_queue, ITEM_TYPE *p_new_item);                                      \
+    size_t           NAME##_enqueue_batch(struct NAME *p_queue, ITEM_TYPE *p_new_items, size_t num);                   \
+    ITEM_TYPE       *NAME##_reserve(struct NAME *p_queue);                                                             \
+    void             NAME##_commit(struct NAME *p_queue);                                                              \
+    dequeue_result_t NAME##_dequeue(struct NAME *p_queue, ITEM_TYPE *p_item_out);                                      \
+    size_t           NAME##_dequeue_batch(struct NAME *p_queue, ITEM_TYPE *p_items_out, size_t num);                   \
+    ITEM_TYPE       *NAME##_peek(struct NAME *p_queue);                                                                \
+    void             NAME##_release(struct NAME *p_queue);                                                             \
+    int              NAME##_is_empty(struct NAME *p_queue);                                                            \
+    int              NAME##_is_full(struct NAME *p_queue);
+
+#define SPSC_QUEUE_DEFINITION(NAME, ITEM_TYPE)                                                                         \
+    void NAME##_init(struct NAME *p_queue) {                                                                           \
+        __atomic_store_n(&p_queue->read_idx, 0, __ATOMIC_RELAXED);                                                     \
+        __atomic_store_n(&p_queue->write_idx, 0, __ATOMIC_RELEASE);                                                    \
+    }                                                                                                                  \
+                                                                                                                       \
+    /* Free slots as seen by the producer */                                                                           \
+    static inline size_t NAME##_free(struct NAME *p_queue) {                                                           \
+        uint32_t write_idx = __atomic_load_n(&p_queue->write_idx, __ATOMIC_RELAXED);                                   \
+        uint32_t read_idx  = __atomic_load_n(&p_queue->read_idx, __ATOMIC_ACQUIRE);                                    \
+        return ARRAY_LENGTH(p_queue->items) - (uint32_t)(write_idx - read_idx);                                        \
+    }                                                                                                                  \
+                                                                                                                       \
+    /* Items available as seen by the consumer */                                                                      \
+    static inline size_t NAME##_available(struct NAME *p_queue) {                                                      \
+        uint32_t read_idx  = __atomic_load_n(&p_queue->read_idx, __ATOMIC_RELAXED);                                    \
+        uint32_t write_idx = __atomic_load_n(&p_queue->write_idx, __ATOMIC_ACQUIRE);                                   \
+        return (uint32_t)(write_idx - read_idx);                                                                       \
+    }                                                                                                                  \
+                                                                                                                       \
+    ITEM_TYPE *NAME##_reserve(struct NAME *p_queue) {                                                                  \
+        if (NAME##_free(p_queue) == 0) {                                                                               \
+            return NULL;                                                                                               \
+        }                                                                                                              \
+        uint32_t write_idx = __atomic_load_n(&p_queue->write_idx, __ATOMIC_RELAXED);                                   \
+        return &p_queue->items[write_idx & (ARRAY_LENGTH(p_queue->items) - 1)];                                        \
+    }                                                                                                                  \
+                                                                                                                       \
+    void NAME##_commit(struct NAME *p_queue) {                                                                         \
+        uint32_t write_idx = __atomic_load_n(&p_queue->write_idx, __ATOMIC_RELAXED);                                   \
+        __atomic_store_n(&p_queue->write_idx, write_idx + 1, __ATOMIC_RELEASE);                                        \
+    }                                                                                                                  \
+                                                                                                                       \
+    enqueue_result_t NAME##_enqueue(struct NAME *p_queue, ITEM_TYPE *p_new_item) {                                     \
+        ITEM_TYPE *slot = NAME##_reserve(p_queue);                                                                     \
+        if (slot == NULL) {                                                                                            \
+            return ENQUEUE_RESULT_FULL;                                                                                \
+        }                                                                                                              \
+        *slot = *p_new_item;                                                                                           \
+        NAME##_commit(p_queue);                                                                                        \
+        return ENQUEUE_RESULT_SUCCESS;                                                                                 \
+    }                                                                                                                  \
+                                                                                                                       \
+    size_t NAME##_enqueue_batch(struct NAME *p_queue, ITEM_TYPE *p_new_items, size_t num) {                            \
+        size_t const capacity  = ARRAY_LENGTH(p_queue->items);                                                         \
+        size_t       space     = NAME##_free(p_queue);                                                                 \
+        uint32_t     write_idx = __atomic_load_n(&p_queue->write_idx, __ATOMIC_RELAXED);                               \
+                                                                                                                       \
+        if (num > space) {                                                                                             \
+            num = space;                                                                                               \
+        }                                                                                                              \
+        for (size_t i = 0; i < num; i++) {                                                                             \
+            p_queue->items[(write_idx + i) & (capacity - 1)] = p_new_items[i];                                         \
+        }                                                                                                              \
+        __atomic_store_n(&p_queue->write_idx, write_idx + num, __ATOMIC_RELEASE);                                      \
+        return num;                                                                                                    \
+    }                                                                                                                  \
+                                                                                                                       \
+    ITEM_TYPE *NAME##_peek(struct NAME *p_queue) {                                                                     \
+        if (NAME##_available(p_queue) == 0) {                                                                          \
+            return NULL;                                                                                               \
+        }                                                                                                              \
+        uint32_t read_idx = __atomic_load_n(&p_queue->read_idx, __ATOMIC_RELAXED);                                     \
+        return &p_queue->items[read_idx & (ARRAY_LENGTH(p_queue->items) - 1)];                                         \
+    }                                                                                                                  \
+                                                                                                                       \
+    void NAME##_release(struct NAME *p_queue) {                                                                        \
+        uint32_t read_idx = __atomic_load_n(&p_queue->read_idx, __ATOMIC_RELAXED);                                     \
+        __atomic_store_n(&p_queue->read_idx, read_idx + 1, __ATOMIC_RELEASE);                                          \
+    }                                                                                                                  \
+                                                                                                                       \
+    dequeue_result_t NAME##_dequeue(struct NAME *p_queue, ITEM_TYPE *p_item_out) {                                     \
+        ITEM_TYPE *slot = NAME##_peek(p_queue);                                                                        \
+        if (slot == NULL) {                                                                                            \
+            return DEQUEUE_RESULT_EMPTY;                                                                               \
+        }                                                                                                              \
+        if (p_item_out)                                                                                                \
+            *p_item_out = *slot;                                                                                       \
+        NAME##_release(p_queue);                                                                                       \
+        return DEQUEUE_RESULT_SUCCESS;                                                                                 \
+    }                                                                                                                  \
+                                                                                                                       \
+    size_t NAME##_dequeue_batch(struct NAME *p_queue, ITEM_TYPE *p_items_out, size_t num) {                            \
+        size_t const capacity  = ARRAY_LENGTH(p_queue->items);                                                         \
+        size_t       available = NAME##_available(p_queue);                                                            \
+        uint32_t     read_idx  = __atomic_load_n(&p_queue->read_idx, __ATOMIC_RELAXED);                                \
+                                                                                                                       \
+        if (num > available) {                                                                                         \
+            num = available;                                                                                           \
+        }                                                                                                              \
+        for (size_t i = 0; i < num; i++) {                                                                             \
+            p_items_out[i] = p_queue->items[(read_idx + i) & (capacity - 1)];                                          \
+        }                                                                                                              \
+        __atomic_store_n(&p_queue->read_idx, read_idx + num, __ATOMIC_RELEASE);                                        \
+        return num;                                                                                                    \
+    }                                                                                                                  \
+                                                                                                                       \
+    int NAME##_is_empty(struct NAME *p_queue) {                                                                        \
+        return NAME##_available(p_queue) == 0;                                                                         \
+    }                                                                                                                  \
+                                                                                                                       \
+    int NAME##_is_full(struct NAME *p_queue) {                                                                         \
+        return NAME##_free(p_queue) == 0;                                                                              \
+    }
+
 #endif
\ No newline at end of file
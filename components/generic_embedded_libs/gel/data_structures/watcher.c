@@ -85,4 +85,48 @@ int watcher_process_changes(watcher_t *list, unsigned long timestamp) {
     }
 
     return res;
-}
\ No newline at end of file
+}
+
+
+int watcher_process_notified(watcher_t *list, size_t num, watcher_bitmap_t *dirty, watcher_bitmap_t *moved,
+                             unsigned long timestamp) {
+    int res = 0;
+
+    for (size_t word = 0; word < WATCHER_BITMAP_WORDS(num); word++) {
+        watcher_bitmap_t changed = dirty[word];
+        dirty[word]              = 0;
+
+        while (changed) {
+            size_t bit = __builtin_ctz(changed);
+            size_t i   = word * 32 + bit;
+            changed &= changed - 1;
+
+            if (i >= num) {
+                break;
+            }
+
+            if (list[i].delay > 0) {
+                list[i].timestamp = timestamp;
+                moved[word] |= 1UL << bit;
+            } else {
+                list[i].cb(list[i].current, list[i].data);
+            }
+            res = 1;
+        }
+
+        // Delayed entries waiting for their timeout; the ones just notified have been rescheduled above
+        watcher_bitmap_t waiting = moved[word];
+        while (waiting) {
+            size_t bit = __builtin_ctz(waiting);
+            size_t i   = word * 32 + bit;
+            waiting &= waiting - 1;
+
+            if (is_expired(list[i].timestamp, timestamp, list[i].delay)) {
+                moved[word] &= ~(1UL << bit);
+                list[i].cb(list[i].current, list[i].data);
+            }
+        }
+    }
+
+    return res;
+}
@@ -29,6 +29,17 @@
 #define WATCHER_DELAYED(ptr, cb, data, delay) WATCHER_DELAYED_ARRAY((ptr), 1, (cb), (data), (delay))
 #define WATCHER_NULL                          WATCHER((uint8_t *)NULL, NULL, NULL)
 
+/*
+ *  Notify mode: no shadow copy is kept, the owner of the memory sets the watcher's bit in a bitmap whenever it is
+ *  written and only flagged entries are processed (see watcher_process_notified)
+ */
+#define WATCHER_NOTIFY(ptr, cb, data)                WATCHER_NOTIFY_DELAYED((ptr), (cb), (data), 0)
+#define WATCHER_NOTIFY_DELAYED(ptr, cb, data, delay) WATCHER_DELAYED_ARRAY((ptr), 0, (cb), (data), (delay))
+
+#define WATCHER_BITMAP_WORDS(num) (((num) + 31) / 32)
+
+typedef uint32_t watcher_bitmap_t;
+
 typedef void (*watcher_cb_t)(void *mem, void *data);
 
 
@@ -87,6 +98,32 @@ int watcher_process_changes(watcher_t *list, unsigned long timestamp);
  */
 void watcher_clear_changes(watcher_t *list, unsigned long timestamp);
 
+/*
+ *  Flags the index-th watcher of a notify mode list as changed
+ *
+ * bitmap: dirty bitmap, WATCHER_BITMAP_WORDS(num) words long
+ * index: index of the changed element
+ */
+static inline void watcher_notify(watcher_bitmap_t *bitmap, size_t index) {
+    bitmap[index / 32] |= 1UL << (index % 32);
+}
+
+/*
+ *  Fires the callbacks of the notify mode watchers flagged in `dirty`, clearing it. Delayed watchers are fired once
+ *  their delay has passed since the last notification. The cost is proportional to the flagged and waiting entries,
+ *  not to the length of the list.
+ *
+ * list: array of `num` watchers built with WATCHER_NOTIFY or WATCHER_NOTIFY_DELAYED; does not need initialization
+ * num: number of watchers in the list
+ * dirty: bitmap of the changed watchers, WATCHER_BITMAP_WORDS(num) words long
+ * moved: bitmap of the delayed watchers that are waiting, same size as `dirty` and zero initialized; owned by the list
+ * timestamp: a timestamp to check whether the delays (if any) have passed
+ *
+ * return: 1 if one of the elements has changed, 0 otherwise
+ */
+int watcher_process_notified(watcher_t *list, size_t num, watcher_bitmap_t *dirty, watcher_bitmap_t *moved,
+                             unsigned long timestamp);
+
 /*
  *  Triggers the callback for the index-th element
  *
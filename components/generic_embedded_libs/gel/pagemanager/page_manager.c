@@ -11,19 +11,30 @@
 
 STACK_DEFINITION(navigation_stack, pman_page_t);
 
+
+static void leave_page(page_manager_t *pman, pman_page_t *page);
+static void discard_page(page_manager_t *pman, pman_page_t *page);
+static void enter_page(page_manager_t *pman, pman_model_t model);
+static void enter_new_page(page_manager_t *pman, pman_model_t model, pman_page_t newpage, void *extra);
+static void close_hidden_page(page_manager_t *pman, pman_page_t *page);
+static void evict_retained_page(page_manager_t *pman, size_t index);
+static void enforce_retain_budget(page_manager_t *pman);
+
+
 static void clear_page_stack(page_manager_t *pman) {
     pman_page_t page;
 
     while (navigation_stack_pop(&pman->page_stack, &page) == POP_RESULT_SUCCESS) {
-        if (page.destroy) {
-            page.destroy(page.data, page.extra);
-        }
+        discard_page(pman, &page);
     }
 }
 
 
 void pman_init(page_manager_t *pman) {
-    pman->initialized = 0;
+    pman->initialized   = 0;
+    pman->num_retained  = 0;
+    pman->retained_cost = 0;
+    pman->clock         = 0;
     navigation_stack_init(&pman->page_stack);
 }
 
@@ -37,22 +48,11 @@ pman_message_t pman_process_page_event(page_manager_t *pman, pman_model_t model,
 pman_view_t pman_swap_page_extra(page_manager_t *pman, pman_model_t model, pman_page_t newpage, void *extra) {
     pman_page_t *current = &pman->current_page;
 
-    if (current->close)
-        current->close(current->data);
-    if (current->destroy)
-        current->destroy(current->data, current->extra);
-
-    pman->current_page       = newpage;
-    pman->current_page.extra = extra;
-    // Create the newpage
-    if (pman->current_page.create)
-        pman->current_page.data = pman->current_page.create(model, pman->current_page.extra);
-    else
-        pman->current_page.data = PMAN_DATA_NULL;
+    leave_page(pman, current);
+    discard_page(pman, current);
 
-    // Open the page
-    if (pman->current_page.open)
-        pman->current_page.open(model, pman->current_page.data);
+    // Create and open the newpage
+    enter_new_page(pman, model, newpage, extra);
     // Resume the page
     if (pman->current_page.resume)
         pman->current_page.resume(pman->current_page.data);
@@ -72,28 +72,22 @@ pman_view_t pman_swap_page(page_manager_t *pman, pman_model_t model, pman_page_t
 pman_view_t pman_reset_to_page(page_manager_t *pman, pman_model_t model, int id) {
     pman_page_t *current = &pman->current_page;
 
-    if (current->close) {
-        current->close(current->data);
-    }
-    if (current->destroy) {
-        current->destroy(current->data, current->extra);
-    }
+    leave_page(pman, current);
+    discard_page(pman, current);
 
     pman_page_t page;
 
     while (navigation_stack_pop(&pman->page_stack, &page) == POP_RESULT_SUCCESS) {
         if (page.id == id) {
             *current = page;
-            if (current->open) {
-                current->open(model, pman->current_page.data);
-            }
+            enter_page(pman, model);
             if (current->update) {
                 return current->update(model, pman->current_page.data);
             } else {
                 return PMAN_VIEW_NULL;
             }
-        } else if (page.destroy) {
-            page.destroy(page.data, page.extra);
+        } else {
+            discard_page(pman, &page);
         }
     }
 
@@ -104,26 +98,13 @@ pman_view_t pman_reset_to_page(page_manager_t *pman, pman_model_t model, int id)
 pman_view_t pman_rebase_page_extra(page_manager_t *pman, pman_model_t model, pman_page_t newpage, void *extra) {
     pman_page_t *current = &pman->current_page;
 
-    if (current->close) {
-        current->close(current->data);
-    }
-    if (current->destroy) {
-        current->destroy(current->data, current->extra);
-    }
+    leave_page(pman, current);
+    discard_page(pman, current);
 
     clear_page_stack(pman);
 
-    pman->current_page       = newpage;
-    pman->current_page.extra = extra;
-    // Create the newpage
-    if (pman->current_page.create)
-        pman->current_page.data = pman->current_page.create(model, pman->current_page.extra);
-    else
-        pman->current_page.data = PMAN_DATA_NULL;
-
-    // Open the page
-    if (pman->current_page.open)
-        pman->current_page.open(model, pman->current_page.data);
+    // Create and open the newpage
+    enter_new_page(pman, model, newpage, extra);
     // Resume the page
     if (pman->current_page.resume)
         pman->current_page.resume(pman->current_page.data);
@@ -149,11 +130,15 @@ pman_view_t pman_change_page_extra(page_manager_t *pman, pman_model_t model, pma
         current = &pman->current_page;
 
         // Close the page
-        if (current->close)
-            current->close(current->data);
+        leave_page(pman, current);
 
-        if (navigation_stack_is_full(&pman->page_stack))
-            navigation_stack_pop(&pman->page_stack, NULL);
+        if (navigation_stack_is_full(&pman->page_stack)) {
+            pman_page_t dropped;
+            navigation_stack_pop(&pman->page_stack, &dropped);
+            if (dropped.hidden) {
+                discard_page(pman, &dropped);
+            }
+        }
         navigation_stack_push(&pman->page_stack, current);
     } else {
         pman->initialized = 1;
@@ -162,18 +147,8 @@ pman_view_t pman_change_page_extra(page_manager_t *pman, pman_model_t model, pma
     pman_page_t *dest;
     dest = &pman->current_page;
 
-    *dest       = newpage;
-    dest->extra = extra;
-
-    // Create the newpage
-    if (dest->create)
-        dest->data = dest->create(model, extra);
-    else
-        dest->data = PMAN_DATA_NULL;
-
-    // Open the page
-    if (dest->open)
-        dest->open(model, dest->data);
+    // Create and open the newpage
+    enter_new_page(pman, model, newpage, extra);
     // Update the page
     if (dest->update)
         return dest->update(model, dest->data);
@@ -192,14 +167,11 @@ pman_view_t pman_back(page_manager_t *pman, pman_model_t model) {
     if (navigation_stack_pop(&pman->page_stack, &page) == POP_RESULT_SUCCESS) {
         pman_page_t *current = &pman->current_page;
 
-        if (current->close)
-            current->close(pman->current_page.data);
-        if (current->destroy)
-            current->destroy(current->data, current->extra);
+        leave_page(pman, current);
+        discard_page(pman, current);
 
         *current = page;
-        if (current->open)
-            current->open(model, pman->current_page.data);
+        enter_page(pman, model);
         if (current->update)
             return current->update(model, pman->current_page.data);
     }
@@ -216,4 +188,172 @@ pman_view_t pman_page_update(page_manager_t *pman, pman_model_t model) {
         return current->update(model, current->data);
     else
         return PMAN_VIEW_NULL;
-}
\ No newline at end of file
+}
+
+
+void pman_release_retained_pages(page_manager_t *pman) {
+    while (pman->num_retained > 0) {
+        evict_retained_page(pman, pman->num_retained - 1);
+    }
+}
+
+
+static int is_retainable(pman_page_t *page) {
+    return page->retain > 0 && page->retain <= PMAN_RETAIN_BUDGET && page->id != 0 && page->hide != NULL;
+}
+
+
+/*
+ *  The page exits view: it is either closed or hidden
+ */
+static void leave_page(page_manager_t *pman, pman_page_t *page) {
+    if (is_retainable(page)) {
+        page->hide(page->data);
+        page->hidden    = 1;
+        page->last_used = ++pman->clock;
+        pman->retained_cost += page->retain;
+    } else if (page->close) {
+        page->close(page->data);
+    }
+}
+
+
+/*
+ *  The page is done with and will not come back from the navigation stack: hidden pages are kept in the cache,
+ * the others destroyed
+ */
+static void discard_page(page_manager_t *pman, pman_page_t *page) {
+    if (page->hidden) {
+        if (pman->num_retained == PMAN_RETAINED_PAGES) {
+            size_t oldest = 0;
+            for (size_t i = 1; i < pman->num_retained; i++) {
+                if (pman->retained[i].last_used < pman->retained[oldest].last_used) {
+                    oldest = i;
+                }
+            }
+            evict_retained_page(pman, oldest);
+        }
+        pman->retained[pman->num_retained++] = *page;
+    } else if (page->destroy) {
+        page->destroy(page->data, page->extra);
+    }
+}
+
+
+/*
+ *  The current page is back in view from the navigation stack
+ */
+static void enter_page(page_manager_t *pman, pman_model_t model) {
+    pman_page_t *current = &pman->current_page;
+
+    if (current->hidden) {
+        current->hidden = 0;
+        pman->retained_cost -= current->retain;
+        if (current->show) {
+            current->show(model, current->data);
+        }
+    } else if (current->open) {
+        current->open(model, current->data);
+    }
+
+    enforce_retain_budget(pman);
+}
+
+
+/*
+ *  A new page enters view; a hidden instance from the cache is reused if the page is not given any extra argument
+ */
+static void enter_new_page(page_manager_t *pman, pman_model_t model, pman_page_t newpage, void *extra) {
+    pman_page_t *dest = &pman->current_page;
+
+    if (is_retainable(&newpage)) {
+        for (size_t i = 0; i < pman->num_retained; i++) {
+            if (pman->retained[i].id != newpage.id) {
+                continue;
+            }
+
+            if (extra == NULL) {
+                *dest             = pman->retained[i];
+                pman->retained[i] = pman->retained[--pman->num_retained];
+                enter_page(pman, model);
+                return;
+            } else {
+                // The instance was built with another argument
+                evict_retained_page(pman, i);
+                break;
+            }
+        }
+    }
+
+    *dest        = newpage;
+    dest->extra  = extra;
+    dest->hidden = 0;
+
+    // Create the newpage
+    if (dest->create)
+        dest->data = dest->create(model, extra);
+    else
+        dest->data = PMAN_DATA_NULL;
+
+    // Open the page
+    if (dest->open)
+        dest->open(model, dest->data);
+
+    enforce_retain_budget(pman);
+}
+
+
+static void close_hidden_page(page_manager_t *pman, pman_page_t *page) {
+    page->hidden = 0;
+    pman->retained_cost -= page->retain;
+    if (page->close) {
+        page->close(page->data);
+    }
+}
+
+
+static void evict_retained_page(page_manager_t *pman, size_t index) {
+    pman_page_t page      = pman->retained[index];
+    pman->retained[index] = pman->retained[--pman->num_retained];
+
+    close_hidden_page(pman, &page);
+    if (page.destroy) {
+        page.destroy(page.data, page.extra);
+    }
+}
+
+
+/*
+ *  Closes the least recently used hidden pages, in the cache or on the navigation stack, until their cost is
+ * within budget. Pages on the stack stay there and are opened again when they come back
+ */
+static void enforce_retain_budget(page_manager_t *pman) {
+    while (pman->retained_cost > PMAN_RETAIN_BUDGET) {
+        pman_page_t *oldest       = NULL;
+        size_t       oldest_index = 0;
+        int          in_cache     = 0;
+
+        for (size_t i = 0; i < pman->num_retained; i++) {
+            if (oldest == NULL || pman->retained[i].last_used < oldest->last_used) {
+                oldest       = &pman->retained[i];
+                oldest_index = i;
+                in_cache     = 1;
+            }
+        }
+        for (size_t i = 0; i < pman->page_stack.idx; i++) {
+            pman_page_t *page = &pman->page_stack.items[i];
+            if (page->hidden && (oldest == NULL || page->last_used < oldest->last_used)) {
+                oldest   = page;
+                in_cache = 0;
+            }
+        }
+
+        if (oldest == NULL) {
+            break;
+        } else if (in_cache) {
+            evict_retained_page(pman, oldest_index);
+        } else {
+            close_hidden_page(pman, oldest);
+        }
+    }
+}
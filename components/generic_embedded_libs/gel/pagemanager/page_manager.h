@@ -4,6 +4,11 @@
 /*
  *  Module that manages a stack of pages; to be used in tandem with some kind of view or display module.
  *  It heavily relies on typedefs to know which types should be passed to the page callbacks
+ *
+ *  Pages that are expensive to build can be retained: instead of being closed when they leave the view they are
+ * hidden, and shown again as they are when they come back. Pages that would be destroyed while hidden are kept in a
+ * small cache and reused by the next navigation to a page with the same id. The total cost of the hidden pages is
+ * kept within PMAN_RETAIN_BUDGET by closing the least recently used ones.
  */
 
 #include "../collections/stack.h"
@@ -17,6 +22,16 @@
 #error "Configuration not defined"
 #endif
 
+// Hidden pages that are not on the navigation stack anymore
+#ifndef PMAN_RETAINED_PAGES
+#define PMAN_RETAINED_PAGES 2
+#endif
+
+// Total cost of the hidden pages, in the same unit as the `retain` field of the pages; 0 disables retention
+#ifndef PMAN_RETAIN_BUDGET
+#define PMAN_RETAIN_BUDGET 0
+#endif
+
 
 typedef struct {
     int              id;
@@ -42,6 +57,18 @@ typedef struct {
     pman_view_t (*update)(pman_model_t model, pman_page_data_t data);
     // Called to process an event
     pman_message_t (*process_event)(pman_model_t model, pman_page_data_t data, pman_event_t event);
+
+    // Cost of keeping the page hidden instead of closing it (e.g. its memory footprint); 0 never retains the page.
+    // Retained pages need a non-zero id and the hide callback
+    unsigned long retain;
+    // Called instead of close when the page exits view but is retained
+    void (*hide)(pman_page_data_t data);
+    // Called instead of open when a hidden page is back in view
+    void (*show)(pman_model_t model, pman_page_data_t data);
+
+    // Managed by the page manager
+    int           hidden;
+    unsigned long last_used;
 } pman_page_t;
 
 STACK_DECLARATION(navigation_stack, pman_page_t, PMAN_NAVIGATION_DEPTH);
@@ -50,6 +77,11 @@ typedef struct {
     int                     initialized;
     pman_page_t             current_page;
     struct navigation_stack page_stack;
+
+    pman_page_t   retained[PMAN_RETAINED_PAGES];
+    size_t        num_retained;
+    unsigned long retained_cost;
+    unsigned long clock;
 } page_manager_t;
 
 
@@ -141,4 +173,12 @@ pman_view_t pman_swap_page(page_manager_t *pman, pman_model_t model, pman_page_t
 
 pman_view_t pman_reset_to_page(page_manager_t *pman, pman_model_t model, int id);
 
+
+/*
+ *  Closes and destroys every hidden page that is not on the navigation stack
+ *
+ * pman: pointer to the page manager struct
+ */
+void pman_release_retained_pages(page_manager_t *pman);
+
 #endif
\ No newline at end of file
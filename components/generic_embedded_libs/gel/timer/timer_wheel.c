@@ -0,0 +1,161 @@
+#include <string.h>
+#include "timer_wheel.h"
+#include "timecheck.h"
+
+
+static void insert_timer(gel_timer_wheel_t *wheel, gel_wheel_timer_t *timer);
+static void remove_timer(gel_timer_wheel_t *wheel, gel_wheel_timer_t *timer);
+
+
+void gel_timer_wheel_init(gel_timer_wheel_t *wheel, unsigned long timestamp) {
+    memset(wheel->slots, 0, sizeof(wheel->slots));
+    wheel->tick                = 0;
+    wheel->time                = timestamp;
+    wheel->next_deadline       = 0;
+    wheel->next_deadline_valid = 0;
+    wheel->count               = 0;
+}
+
+
+void gel_timer_wheel_activate(gel_timer_wheel_t *wheel, gel_wheel_timer_t *timer, unsigned long delay,
+                              unsigned long timestamp, gel_wheel_timer_callback_t cb, void *arg) {
+    gel_timer_wheel_deactivate(wheel, timer);
+
+    timer->deadline = timestamp + delay;
+    timer->period   = 0;
+    timer->callback = cb;
+    timer->arg      = arg;
+    insert_timer(wheel, timer);
+}
+
+
+void gel_timer_wheel_set_period(gel_wheel_timer_t *timer, unsigned long period) {
+    timer->period = period;
+}
+
+
+void gel_timer_wheel_deactivate(gel_timer_wheel_t *wheel, gel_wheel_timer_t *timer) {
+    if (gel_timer_wheel_is_active(timer)) {
+        remove_timer(wheel, timer);
+    }
+}
+
+
+int gel_timer_wheel_manage_callbacks(gel_timer_wheel_t *wheel, unsigned long timestamp, void *user_pointer) {
+    int res = 0;
+
+    if (time_before(timestamp, wheel->time)) {
+        return 0;
+    }
+
+    // Ticks are counted from the previous pass rather than derived from the timestamp, so that they do not jump
+    // when the timestamp wraps around
+    unsigned long elapsed = (timestamp - wheel->time) / GEL_TIMER_WHEEL_RESOLUTION;
+    unsigned long now     = wheel->tick + elapsed;
+    unsigned long ticks   = elapsed + 1;
+    // Both move forward before any callback, as timers armed from there are placed relative to them
+    wheel->time += elapsed * GEL_TIMER_WHEEL_RESOLUTION;
+    wheel->tick = now;
+
+    // After a long pause every slot is visited once
+    if (ticks > GEL_TIMER_WHEEL_SLOTS) {
+        ticks = GEL_TIMER_WHEEL_SLOTS;
+    }
+
+    // The slot of the last tick is visited again, as it may hold deadlines that were still a few ms away
+    for (unsigned long i = 0; i < ticks; i++) {
+        gel_wheel_timer_t **slot = &wheel->slots[(now - i) % GEL_TIMER_WHEEL_SLOTS];
+
+        // Start over after each callback, since it may have changed the list
+        gel_wheel_timer_t *timer = *slot;
+        while (timer != NULL) {
+            if (!time_after_or_equal(timestamp, timer->deadline)) {
+                timer = timer->next;
+                continue;
+            }
+
+            remove_timer(wheel, timer);
+            if (timer->period > 0) {
+                timer->deadline += timer->period;
+                if (time_after_or_equal(timestamp, timer->deadline)) {
+                    timer->deadline = timestamp + timer->period;
+                }
+                insert_timer(wheel, timer);
+            }
+
+            timer->callback(timer, user_pointer, timer->arg);
+            res   = 1;
+            timer = *slot;
+        }
+    }
+
+    return res;
+}
+
+
+unsigned long gel_timer_wheel_get_remaining(gel_timer_wheel_t *wheel, unsigned long timestamp) {
+    if (wheel->count == 0) {
+        return GEL_TIMER_WHEEL_NO_DEADLINE;
+    }
+
+    if (!wheel->next_deadline_valid) {
+        // The earliest timer fired or was cancelled; rare enough to afford a full scan
+        int first = 1;
+        for (size_t i = 0; i < GEL_TIMER_WHEEL_SLOTS; i++) {
+            for (gel_wheel_timer_t *timer = wheel->slots[i]; timer != NULL; timer = timer->next) {
+                if (first || time_before(timer->deadline, wheel->next_deadline)) {
+                    wheel->next_deadline = timer->deadline;
+                    first                = 0;
+                }
+            }
+        }
+        wheel->next_deadline_valid = 1;
+    }
+
+    if (time_after_or_equal(timestamp, wheel->next_deadline)) {
+        return 0;
+    } else {
+        return wheel->next_deadline - timestamp;
+    }
+}
+
+
+static void insert_timer(gel_timer_wheel_t *wheel, gel_wheel_timer_t *timer) {
+    unsigned long tick = wheel->tick;
+    // Deadlines already in the past go in the current slot
+    if (time_after(timer->deadline, wheel->time)) {
+        tick += (timer->deadline - wheel->time) / GEL_TIMER_WHEEL_RESOLUTION;
+    }
+
+    gel_wheel_timer_t **slot = &wheel->slots[tick % GEL_TIMER_WHEEL_SLOTS];
+
+    timer->next = *slot;
+    if (*slot != NULL) {
+        (*slot)->pprev = &timer->next;
+    }
+    *slot        = timer;
+    timer->pprev = slot;
+
+    if (wheel->count == 0) {
+        wheel->next_deadline       = timer->deadline;
+        wheel->next_deadline_valid = 1;
+    } else if (wheel->next_deadline_valid && time_before(timer->deadline, wheel->next_deadline)) {
+        wheel->next_deadline = timer->deadline;
+    }
+    wheel->count++;
+}
+
+
+static void remove_timer(gel_timer_wheel_t *wheel, gel_wheel_timer_t *timer) {
+    *timer->pprev = timer->next;
+    if (timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next  = NULL;
+    timer->pprev = NULL;
+
+    if (timer->deadline == wheel->next_deadline) {
+        wheel->next_deadline_valid = 0;
+    }
+    wheel->count--;
+}
@@ -0,0 +1,105 @@
+#ifndef GEL_TIMER_WHEEL_H_INCLUDED
+#define GEL_TIMER_WHEEL_H_INCLUDED
+
+/*
+ *  Hashed timer wheel. Timers hang from the slot of their deadline tick in an intrusive list, so arming and
+ * cancelling are O(1) and a pass only visits the slots of the ticks that went by since the previous one.
+ * Deadlines further away than a whole revolution share the slot with the nearer ones and are skipped until due.
+ * Like everything else in gel, no dynamic memory is involved: the timers are owned by the caller.
+ */
+
+#include <stdlib.h>
+#include <limits.h>
+
+
+#ifndef GEL_TIMER_WHEEL_SLOTS
+#define GEL_TIMER_WHEEL_SLOTS 64
+#endif
+
+// Milliseconds per tick
+#ifndef GEL_TIMER_WHEEL_RESOLUTION
+#define GEL_TIMER_WHEEL_RESOLUTION 10
+#endif
+
+#define GEL_TIMER_WHEEL_NO_DEADLINE ULONG_MAX
+
+#define GEL_WHEEL_TIMER_NULL ((gel_wheel_timer_t){.next = NULL, .pprev = NULL, .callback = NULL, .arg = NULL})
+
+
+typedef struct gel_wheel_timer_struct {
+    struct gel_wheel_timer_struct  *next;
+    struct gel_wheel_timer_struct **pprev;  // NULL when the timer is not armed
+    unsigned long                   deadline;
+    unsigned long                   period; // 0 for one shot timers
+    void (*callback)(struct gel_wheel_timer_struct *, void *, void *);
+    void *arg;
+} gel_wheel_timer_t;
+
+typedef void (*gel_wheel_timer_callback_t)(gel_wheel_timer_t *, void *, void *);
+
+typedef struct {
+    gel_wheel_timer_t *slots[GEL_TIMER_WHEEL_SLOTS];
+    unsigned long      tick; // Last tick processed
+    unsigned long      time; // Start of the last tick processed
+    unsigned long      next_deadline;
+    int                next_deadline_valid;
+    size_t             count;
+} gel_timer_wheel_t;
+
+
+/*
+ *  Initializes an empty wheel
+ *
+ * wheel: the wheel
+ * timestamp: current time
+ */
+void gel_timer_wheel_init(gel_timer_wheel_t *wheel, unsigned long timestamp);
+
+/*
+ *  Arms a timer, firing `cb` once `delay` milliseconds have passed. If the timer was already armed it is rescheduled.
+ *
+ * wheel: the wheel
+ * timer: the timer; must stay valid while armed
+ * delay: milliseconds from `timestamp` to the deadline
+ * timestamp: current time
+ * cb: callback, invoked with the timer, the user pointer passed to gel_timer_wheel_manage_callbacks and `arg`
+ * arg: user argument
+ */
+void gel_timer_wheel_activate(gel_timer_wheel_t *wheel, gel_wheel_timer_t *timer, unsigned long delay,
+                              unsigned long timestamp, gel_wheel_timer_callback_t cb, void *arg);
+
+/*
+ *  Makes an armed timer fire every `period` milliseconds instead of once; 0 turns it back into a one shot timer
+ */
+void gel_timer_wheel_set_period(gel_wheel_timer_t *timer, unsigned long period);
+
+/*
+ *  Cancels an armed timer; does nothing if it is not armed
+ */
+void gel_timer_wheel_deactivate(gel_timer_wheel_t *wheel, gel_wheel_timer_t *timer);
+
+/*
+ *  Returns whether the timer is armed
+ */
+static inline int gel_timer_wheel_is_active(gel_wheel_timer_t *timer) {
+    return timer->pprev != NULL;
+}
+
+/*
+ *  Fires the callbacks of the expired timers. Callbacks may freely arm and cancel timers, including their own.
+ *
+ * wheel: the wheel
+ * timestamp: current time
+ * user_pointer: passed to every callback
+ *
+ * return: 1 if at least a timer fired, 0 otherwise
+ */
+int gel_timer_wheel_manage_callbacks(gel_timer_wheel_t *wheel, unsigned long timestamp, void *user_pointer);
+
+/*
+ *  Returns the milliseconds left until the earliest deadline (0 if it already passed), or
+ * GEL_TIMER_WHEEL_NO_DEADLINE if no timer is armed
+ */
+unsigned long gel_timer_wheel_get_remaining(gel_timer_wheel_t *wheel, unsigned long timestamp);
+
+#endif
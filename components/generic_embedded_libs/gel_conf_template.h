@@ -11,6 +11,8 @@
  * Page manager
  */
 #define PMAN_NAVIGATION_DEPTH 4
+#define PMAN_RETAINED_PAGES   2
+#define PMAN_RETAIN_BUDGET    8
 #define PMAN_VIEW_NULL
 #define PMAN_DATA_NULL NULL
 
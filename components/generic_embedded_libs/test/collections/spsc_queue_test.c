@@ -0,0 +1,129 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "collections/queue.h"
+#include "unity.h"
+
+SPSC_QUEUE_DECLARATION(test_spsc_queue, uint32_t, 8);
+SPSC_QUEUE_DEFINITION(test_spsc_queue, uint32_t);
+
+struct test_struct {
+    uint32_t sequence;
+    uint8_t  payload[13];
+};
+SPSC_QUEUE_DECLARATION(test_spsc_struct_queue, struct test_struct, 16);
+SPSC_QUEUE_DEFINITION(test_spsc_struct_queue, struct test_struct);
+
+#define STRESS_ITEMS 200000
+
+static struct test_spsc_struct_queue stress_queue;
+
+void setUp() {}
+void tearDown() {}
+
+
+void test_spsc_queue_works_with_integers(void) {
+    struct test_spsc_queue q;
+    test_spsc_queue_init(&q);
+
+    TEST_ASSERT_EQUAL(true, test_spsc_queue_is_empty(&q));
+    TEST_ASSERT_NULL(test_spsc_queue_peek(&q));
+
+    for (uint32_t i = 0; i < 8; i++) {
+        TEST_ASSERT_EQUAL(ENQUEUE_RESULT_SUCCESS, test_spsc_queue_enqueue(&q, &i));
+    }
+    TEST_ASSERT_EQUAL(true, test_spsc_queue_is_full(&q));
+    uint32_t v = 55;
+    TEST_ASSERT_EQUAL(ENQUEUE_RESULT_FULL, test_spsc_queue_enqueue(&q, &v));
+    TEST_ASSERT_NULL(test_spsc_queue_reserve(&q));
+
+    for (uint32_t i = 0; i < 8; i++) {
+        uint32_t out = 0;
+        TEST_ASSERT_EQUAL(DEQUEUE_RESULT_SUCCESS, test_spsc_queue_dequeue(&q, &out));
+        TEST_ASSERT_EQUAL(i, out);
+    }
+    TEST_ASSERT_EQUAL(DEQUEUE_RESULT_EMPTY, test_spsc_queue_dequeue(&q, &v));
+    TEST_ASSERT_EQUAL(true, test_spsc_queue_is_empty(&q));
+}
+
+
+void test_spsc_queue_in_place(void) {
+    struct test_spsc_queue q;
+    test_spsc_queue_init(&q);
+
+    uint32_t *slot = test_spsc_queue_reserve(&q);
+    TEST_ASSERT_NOT_NULL(slot);
+    *slot = 42;
+    // Not visible until committed
+    TEST_ASSERT_EQUAL(true, test_spsc_queue_is_empty(&q));
+    test_spsc_queue_commit(&q);
+
+    uint32_t *item = test_spsc_queue_peek(&q);
+    TEST_ASSERT_NOT_NULL(item);
+    TEST_ASSERT_EQUAL(42, *item);
+    // Peeking does not consume
+    TEST_ASSERT_EQUAL_PTR(item, test_spsc_queue_peek(&q));
+    test_spsc_queue_release(&q);
+    TEST_ASSERT_EQUAL(true, test_spsc_queue_is_empty(&q));
+}
+
+
+void test_spsc_queue_batch(void) {
+    struct test_spsc_queue q;
+    uint32_t               in[12]  = {0};
+    uint32_t               out[12] = {0};
+    test_spsc_queue_init(&q);
+
+    for (uint32_t i = 0; i < 12; i++) {
+        in[i] = i * 3;
+    }
+
+    // Only as many as there is room for are taken
+    TEST_ASSERT_EQUAL(5, test_spsc_queue_enqueue_batch(&q, in, 5));
+    TEST_ASSERT_EQUAL(3, test_spsc_queue_dequeue_batch(&q, out, 3));
+    TEST_ASSERT_EQUAL(6, test_spsc_queue_enqueue_batch(&q, &in[5], 7));
+    TEST_ASSERT_EQUAL(true, test_spsc_queue_is_full(&q));
+
+    // The batch wraps around the end of the buffer
+    TEST_ASSERT_EQUAL(8, test_spsc_queue_dequeue_batch(&q, &out[3], 12));
+    for (uint32_t i = 0; i < 11; i++) {
+        TEST_ASSERT_EQUAL(in[i], out[i]);
+    }
+    TEST_ASSERT_EQUAL(0, test_spsc_queue_dequeue_batch(&q, out, 12));
+}
+
+
+static void *producer(void *arg) {
+    (void)arg;
+    for (uint32_t i = 0; i < STRESS_ITEMS;) {
+        struct test_struct *slot = test_spsc_struct_queue_reserve(&stress_queue);
+        if (slot != NULL) {
+            slot->sequence = i;
+            memset(slot->payload, (uint8_t)i, sizeof(slot->payload));
+            test_spsc_struct_queue_commit(&stress_queue);
+            i++;
+        }
+    }
+    return NULL;
+}
+
+
+void test_spsc_queue_across_threads(void) {
+    pthread_t thread;
+    test_spsc_struct_queue_init(&stress_queue);
+    pthread_create(&thread, NULL, producer, NULL);
+
+    for (uint32_t expected = 0; expected < STRESS_ITEMS;) {
+        struct test_struct items[4];
+        size_t             num = test_spsc_struct_queue_dequeue_batch(&stress_queue, items, 4);
+
+        for (size_t i = 0; i < num; i++) {
+            TEST_ASSERT_EQUAL(expected, items[i].sequence);
+            TEST_ASSERT_EACH_EQUAL_UINT8((uint8_t)expected, items[i].payload, sizeof(items[i].payload));
+            expected++;
+        }
+    }
+
+    pthread_join(thread, NULL);
+    TEST_ASSERT_EQUAL(true, test_spsc_struct_queue_is_empty(&stress_queue));
+}
@@ -60,4 +60,59 @@ void test_watcher_delayed() {
     TEST_ASSERT_EQUAL(0, cbtest);
     TEST_ASSERT(!watcher_process_changes(list, 11000));
     TEST_ASSERT_EQUAL(1, cbtest);
-}
\ No newline at end of file
+}
+
+void test_watcher_notify() {
+    watcher_t list[] = {
+        WATCHER_NOTIFY(&var1, callback, NULL),
+        WATCHER_NOTIFY(&var2, callback, NULL),
+        WATCHER_NOTIFY_DELAYED(&var3, callback, NULL, 5000),
+    };
+    watcher_bitmap_t dirty[WATCHER_BITMAP_WORDS(3)] = {0};
+    watcher_bitmap_t moved[WATCHER_BITMAP_WORDS(3)] = {0};
+
+    TEST_ASSERT(!watcher_process_notified(list, 3, dirty, moved, 0));
+
+    // Writes that are not notified go unnoticed
+    var1++;
+    TEST_ASSERT(!watcher_process_notified(list, 3, dirty, moved, 0));
+
+    watcher_notify(dirty, 0);
+    watcher_notify(dirty, 1);
+    TEST_ASSERT(watcher_process_notified(list, 3, dirty, moved, 0));
+    TEST_ASSERT_EQUAL(2, cbtest);
+    TEST_ASSERT(!watcher_process_notified(list, 3, dirty, moved, 0));
+    TEST_ASSERT_EQUAL(2, cbtest);
+
+    watcher_notify(dirty, 2);
+    TEST_ASSERT(watcher_process_notified(list, 3, dirty, moved, 0));
+    TEST_ASSERT(!watcher_process_notified(list, 3, dirty, moved, 4000));
+    watcher_notify(dirty, 2);
+    TEST_ASSERT(watcher_process_notified(list, 3, dirty, moved, 6000));
+    TEST_ASSERT_EQUAL(2, cbtest);
+    TEST_ASSERT(!watcher_process_notified(list, 3, dirty, moved, 11000));
+    TEST_ASSERT_EQUAL(3, cbtest);
+    TEST_ASSERT(!watcher_process_notified(list, 3, dirty, moved, 20000));
+    TEST_ASSERT_EQUAL(3, cbtest);
+}
+
+
+void test_watcher_notify_large() {
+    static int       values[40]                      = {0};
+    watcher_t        list[40]                        = {0};
+    watcher_bitmap_t dirty[WATCHER_BITMAP_WORDS(40)] = {0};
+    watcher_bitmap_t moved[WATCHER_BITMAP_WORDS(40)] = {0};
+
+    for (size_t i = 0; i < 40; i++) {
+        list[i] = WATCHER_NOTIFY(&values[i], callback, NULL);
+    }
+
+    watcher_notify(dirty, 3);
+    watcher_notify(dirty, 31);
+    watcher_notify(dirty, 32);
+    watcher_notify(dirty, 39);
+    TEST_ASSERT(watcher_process_notified(list, 40, dirty, moved, 0));
+    TEST_ASSERT_EQUAL(4, cbtest);
+    TEST_ASSERT_EQUAL(0, dirty[0]);
+    TEST_ASSERT_EQUAL(0, dirty[1]);
+}
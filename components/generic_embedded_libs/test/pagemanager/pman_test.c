@@ -6,6 +6,8 @@
 #define PAGE1 1
 #define PAGE2 2
 #define PAGE3 3
+#define PAGE4 4
+#define PAGE5 5
 
 int model;
 
@@ -107,6 +109,79 @@ pman_message_t process_event1(pman_model_t model, pman_page_data_t data, pman_ev
     return 0;
 }
 
+int create4 = 0, open4 = 0, close4 = 0, destroy4 = 0, hide4 = 0, show4 = 0;
+int create5 = 0, open5 = 0, close5 = 0, destroy5 = 0, hide5 = 0, show5 = 0;
+
+pman_page_data_t create_page4(pman_model_t model, void *extra) {
+    (void)extra;
+    (void)model;
+    create4++;
+    return 0;
+}
+
+pman_page_data_t create_page5(pman_model_t model, void *extra) {
+    (void)extra;
+    (void)model;
+    create5++;
+    return 0;
+}
+
+void open_page4(pman_model_t model, pman_page_data_t data) {
+    (void)model;
+    (void)data;
+    open4++;
+}
+
+void open_page5(pman_model_t model, pman_page_data_t data) {
+    (void)model;
+    (void)data;
+    open5++;
+}
+
+void close_page4(pman_page_data_t data) {
+    (void)data;
+    close4++;
+}
+
+void close_page5(pman_page_data_t data) {
+    (void)data;
+    close5++;
+}
+
+void destroy_page4(pman_page_data_t data, void *extra) {
+    (void)data;
+    (void)extra;
+    destroy4++;
+}
+
+void destroy_page5(pman_page_data_t data, void *extra) {
+    (void)data;
+    (void)extra;
+    destroy5++;
+}
+
+void hide_page4(pman_page_data_t data) {
+    (void)data;
+    hide4++;
+}
+
+void hide_page5(pman_page_data_t data) {
+    (void)data;
+    hide5++;
+}
+
+void show_page4(pman_model_t model, pman_page_data_t data) {
+    (void)model;
+    (void)data;
+    show4++;
+}
+
+void show_page5(pman_model_t model, pman_page_data_t data) {
+    (void)model;
+    (void)data;
+    show5++;
+}
+
 page_manager_t pman;
 
 pman_page_t pages[] = {{.id            = PAGE1,
@@ -126,6 +201,24 @@ pman_page_t pages[] = {{.id            = PAGE1,
                         .open          = open_page3,
                         .close         = close_page3,
                         .destroy       = destroy_page3,
+                        .process_event = process_event1},
+                       {.id            = PAGE4,
+                        .create        = create_page4,
+                        .open          = open_page4,
+                        .close         = close_page4,
+                        .destroy       = destroy_page4,
+                        .hide          = hide_page4,
+                        .show          = show_page4,
+                        .retain        = 4,
+                        .process_event = process_event1},
+                       {.id            = PAGE5,
+                        .create        = create_page5,
+                        .open          = open_page5,
+                        .close         = close_page5,
+                        .destroy       = destroy_page5,
+                        .hide          = hide_page5,
+                        .show          = show_page5,
+                        .retain        = 6,
                         .process_event = process_event1}};
 
 void setUp() {
@@ -133,6 +226,8 @@ void setUp() {
     open1 = open2 = open3 = 0;
     close1 = close2 = close3 = 0;
     destroy1 = destroy2 = destroy3 = 0;
+    create4 = open4 = close4 = destroy4 = hide4 = show4 = 0;
+    create5 = open5 = close5 = destroy5 = hide5 = show5 = 0;
     pman_init(&pman);
     model = 1;
 }
@@ -204,3 +299,92 @@ void test_swap_page(void) {
     TEST_ASSERT_EQUAL(0, destroy1);
     TEST_ASSERT_EQUAL(1, destroy3);
 }
+
+
+void test_retained_page_hidden_and_shown(void) {
+    pman_change_page(&pman, model, pages[3]);
+    pman_change_page(&pman, model, pages[1]);
+    TEST_ASSERT_EQUAL(1, hide4);
+    TEST_ASSERT_EQUAL(0, close4);
+
+    pman_back(&pman, model);
+    TEST_ASSERT_EQUAL(PAGE4, pman.current_page.id);
+    TEST_ASSERT_EQUAL(1, create4);
+    TEST_ASSERT_EQUAL(1, open4);
+    TEST_ASSERT_EQUAL(1, show4);
+    TEST_ASSERT_EQUAL(0, close4);
+    TEST_ASSERT_EQUAL(0, pman.retained_cost);
+}
+
+
+void test_retained_page_reused_from_cache(void) {
+    pman_change_page(&pman, model, pages[0]);
+    pman_change_page(&pman, model, pages[3]);
+
+    pman_back(&pman, model);
+    TEST_ASSERT_EQUAL(PAGE1, pman.current_page.id);
+    TEST_ASSERT_EQUAL(1, hide4);
+    TEST_ASSERT_EQUAL(0, destroy4);
+    TEST_ASSERT_EQUAL(1, pman.num_retained);
+
+    pman_change_page(&pman, model, pages[3]);
+    TEST_ASSERT_EQUAL(PAGE4, pman.current_page.id);
+    TEST_ASSERT_EQUAL(1, create4);
+    TEST_ASSERT_EQUAL(1, open4);
+    TEST_ASSERT_EQUAL(1, show4);
+    TEST_ASSERT_EQUAL(0, pman.num_retained);
+
+    // The same goes for pages coming back through a rebase
+    pman_change_page(&pman, model, pages[1]);
+    pman_rebase_page(&pman, model, pages[3]);
+    TEST_ASSERT_EQUAL(PAGE4, pman.current_page.id);
+    TEST_ASSERT_EQUAL(1, create4);
+    TEST_ASSERT_EQUAL(2, show4);
+    TEST_ASSERT_EQUAL(1, destroy1);
+}
+
+
+void test_retained_page_not_reused_with_extra(void) {
+    int extra = 0;
+
+    pman_change_page(&pman, model, pages[0]);
+    pman_change_page(&pman, model, pages[3]);
+    pman_back(&pman, model);
+
+    pman_change_page_extra(&pman, model, pages[3], &extra);
+    TEST_ASSERT_EQUAL(1, close4);
+    TEST_ASSERT_EQUAL(1, destroy4);
+    TEST_ASSERT_EQUAL(2, create4);
+    TEST_ASSERT_EQUAL(2, open4);
+    TEST_ASSERT_EQUAL(0, show4);
+}
+
+
+void test_retained_pages_within_budget(void) {
+    pman_change_page(&pman, model, pages[3]);
+    pman_change_page(&pman, model, pages[4]);
+    pman_change_page(&pman, model, pages[0]);
+
+    // Both hidden would cost 10: the least recently used one is closed
+    TEST_ASSERT_EQUAL(1, close4);
+    TEST_ASSERT_EQUAL(0, close5);
+    TEST_ASSERT_EQUAL(6, pman.retained_cost);
+
+    pman_back(&pman, model);
+    TEST_ASSERT_EQUAL(PAGE5, pman.current_page.id);
+    TEST_ASSERT_EQUAL(1, show5);
+
+    pman_back(&pman, model);
+    TEST_ASSERT_EQUAL(PAGE4, pman.current_page.id);
+    TEST_ASSERT_EQUAL(0, show4);
+    TEST_ASSERT_EQUAL(2, open4);
+    TEST_ASSERT_EQUAL(1, create4);
+    TEST_ASSERT_EQUAL(0, destroy5);
+    TEST_ASSERT_EQUAL(1, pman.num_retained);
+
+    pman_release_retained_pages(&pman);
+    TEST_ASSERT_EQUAL(1, close5);
+    TEST_ASSERT_EQUAL(1, destroy5);
+    TEST_ASSERT_EQUAL(0, pman.num_retained);
+    TEST_ASSERT_EQUAL(0, pman.retained_cost);
+}
@@ -0,0 +1,221 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "timer/timer_wheel.h"
+#include "unity.h"
+
+
+static gel_timer_wheel_t wheel;
+static int               fired = 0;
+
+void setUp() {
+    fired = 0;
+    gel_timer_wheel_init(&wheel, 0);
+}
+
+void tearDown() {}
+
+
+static void count_callback(gel_wheel_timer_t *timer, void *user, void *arg) {
+    (void)timer;
+    (void)user;
+    (void)arg;
+    fired++;
+}
+
+
+static void cancel_callback(gel_wheel_timer_t *timer, void *user, void *arg) {
+    (void)timer;
+    (void)user;
+    gel_timer_wheel_deactivate(&wheel, arg);
+    fired++;
+}
+
+
+void test_one_shot() {
+    gel_wheel_timer_t timer = GEL_WHEEL_TIMER_NULL;
+
+    TEST_ASSERT_EQUAL(GEL_TIMER_WHEEL_NO_DEADLINE, gel_timer_wheel_get_remaining(&wheel, 0));
+
+    gel_timer_wheel_activate(&wheel, &timer, 100, 0, count_callback, NULL);
+    TEST_ASSERT(gel_timer_wheel_is_active(&timer));
+    TEST_ASSERT_EQUAL(100, gel_timer_wheel_get_remaining(&wheel, 0));
+    TEST_ASSERT_EQUAL(40, gel_timer_wheel_get_remaining(&wheel, 60));
+
+    TEST_ASSERT(!gel_timer_wheel_manage_callbacks(&wheel, 50, NULL));
+    TEST_ASSERT(!gel_timer_wheel_manage_callbacks(&wheel, 99, NULL));
+    TEST_ASSERT(gel_timer_wheel_manage_callbacks(&wheel, 100, NULL));
+    TEST_ASSERT_EQUAL(1, fired);
+    TEST_ASSERT(!gel_timer_wheel_is_active(&timer));
+    TEST_ASSERT(!gel_timer_wheel_manage_callbacks(&wheel, 1000, NULL));
+    TEST_ASSERT_EQUAL(GEL_TIMER_WHEEL_NO_DEADLINE, gel_timer_wheel_get_remaining(&wheel, 1000));
+}
+
+
+void test_same_tick() {
+    gel_wheel_timer_t timer = GEL_WHEEL_TIMER_NULL;
+
+    // Deadline in the middle of a tick
+    gel_timer_wheel_activate(&wheel, &timer, GEL_TIMER_WHEEL_RESOLUTION / 2, 0, count_callback, NULL);
+    TEST_ASSERT(!gel_timer_wheel_manage_callbacks(&wheel, 1, NULL));
+    TEST_ASSERT(gel_timer_wheel_manage_callbacks(&wheel, GEL_TIMER_WHEEL_RESOLUTION / 2, NULL));
+    TEST_ASSERT_EQUAL(1, fired);
+}
+
+
+void test_cancel_and_reschedule() {
+    gel_wheel_timer_t first  = GEL_WHEEL_TIMER_NULL;
+    gel_wheel_timer_t second = GEL_WHEEL_TIMER_NULL;
+
+    gel_timer_wheel_activate(&wheel, &first, 100, 0, count_callback, NULL);
+    gel_timer_wheel_activate(&wheel, &second, 300, 0, count_callback, NULL);
+
+    gel_timer_wheel_deactivate(&wheel, &first);
+    TEST_ASSERT(!gel_timer_wheel_is_active(&first));
+    TEST_ASSERT_EQUAL(300, gel_timer_wheel_get_remaining(&wheel, 0));
+    // Cancelling twice is harmless
+    gel_timer_wheel_deactivate(&wheel, &first);
+
+    // Arming an armed timer moves its deadline
+    gel_timer_wheel_activate(&wheel, &second, 300, 200, count_callback, NULL);
+    TEST_ASSERT(!gel_timer_wheel_manage_callbacks(&wheel, 300, NULL));
+    TEST_ASSERT_EQUAL(200, gel_timer_wheel_get_remaining(&wheel, 300));
+    TEST_ASSERT(gel_timer_wheel_manage_callbacks(&wheel, 500, NULL));
+    TEST_ASSERT_EQUAL(1, fired);
+}
+
+
+void test_periodic() {
+    gel_wheel_timer_t timer = GEL_WHEEL_TIMER_NULL;
+
+    gel_timer_wheel_activate(&wheel, &timer, 50, 0, count_callback, NULL);
+    gel_timer_wheel_set_period(&timer, 50);
+
+    for (unsigned long t = 0; t <= 500; t += 10) {
+        gel_timer_wheel_manage_callbacks(&wheel, t, NULL);
+    }
+    TEST_ASSERT_EQUAL(10, fired);
+    TEST_ASSERT(gel_timer_wheel_is_active(&timer));
+    TEST_ASSERT_EQUAL(50, gel_timer_wheel_get_remaining(&wheel, 500));
+
+    // Missed periods are not recovered in a burst
+    TEST_ASSERT(gel_timer_wheel_manage_callbacks(&wheel, 2000, NULL));
+    TEST_ASSERT_EQUAL(11, fired);
+    TEST_ASSERT_EQUAL(50, gel_timer_wheel_get_remaining(&wheel, 2000));
+}
+
+
+void test_beyond_one_revolution() {
+    gel_wheel_timer_t near       = GEL_WHEEL_TIMER_NULL;
+    gel_wheel_timer_t far        = GEL_WHEEL_TIMER_NULL;
+    unsigned long     revolution = GEL_TIMER_WHEEL_SLOTS * GEL_TIMER_WHEEL_RESOLUTION;
+
+    // Both timers end up in the same slot
+    gel_timer_wheel_activate(&wheel, &near, 100, 0, count_callback, NULL);
+    gel_timer_wheel_activate(&wheel, &far, 100 + 3 * revolution, 0, count_callback, NULL);
+
+    for (unsigned long t = 0; t < 100 + 3 * revolution; t += 10) {
+        gel_timer_wheel_manage_callbacks(&wheel, t, NULL);
+    }
+    TEST_ASSERT_EQUAL(1, fired);
+    TEST_ASSERT_EQUAL(10, gel_timer_wheel_get_remaining(&wheel, 90 + 3 * revolution));
+    TEST_ASSERT(gel_timer_wheel_manage_callbacks(&wheel, 100 + 3 * revolution, NULL));
+    TEST_ASSERT_EQUAL(2, fired);
+}
+
+
+void test_long_pause() {
+    gel_wheel_timer_t timers[3] = {GEL_WHEEL_TIMER_NULL, GEL_WHEEL_TIMER_NULL, GEL_WHEEL_TIMER_NULL};
+
+    gel_timer_wheel_activate(&wheel, &timers[0], 10, 0, count_callback, NULL);
+    gel_timer_wheel_activate(&wheel, &timers[1], 230, 0, count_callback, NULL);
+    gel_timer_wheel_activate(&wheel, &timers[2], 5000, 0, count_callback, NULL);
+
+    // The main loop was stuck for a while: everything due fires at once
+    TEST_ASSERT(gel_timer_wheel_manage_callbacks(&wheel, 10000, NULL));
+    TEST_ASSERT_EQUAL(3, fired);
+}
+
+
+void test_callback_cancels_other() {
+    gel_wheel_timer_t first  = GEL_WHEEL_TIMER_NULL;
+    gel_wheel_timer_t second = GEL_WHEEL_TIMER_NULL;
+
+    gel_timer_wheel_activate(&wheel, &first, 100, 0, cancel_callback, &second);
+    gel_timer_wheel_activate(&wheel, &second, 100, 0, cancel_callback, &first);
+
+    TEST_ASSERT(gel_timer_wheel_manage_callbacks(&wheel, 100, NULL));
+    TEST_ASSERT_EQUAL(1, fired);
+    TEST_ASSERT(!gel_timer_wheel_is_active(&first));
+    TEST_ASSERT(!gel_timer_wheel_is_active(&second));
+}
+
+
+void test_wraparound() {
+    gel_wheel_timer_t timer = GEL_WHEEL_TIMER_NULL;
+    unsigned long     start = ULONG_MAX - 50;
+
+    gel_timer_wheel_init(&wheel, start);
+    gel_timer_wheel_activate(&wheel, &timer, 100, start, count_callback, NULL);
+    TEST_ASSERT(!gel_timer_wheel_manage_callbacks(&wheel, start + 60, NULL));
+    TEST_ASSERT_EQUAL(40, gel_timer_wheel_get_remaining(&wheel, start + 60));
+    TEST_ASSERT(gel_timer_wheel_manage_callbacks(&wheel, start + 100, NULL));
+    TEST_ASSERT_EQUAL(1, fired);
+}
+
+
+static unsigned long now           = 0;
+static unsigned long fire_times[8] = {0};
+
+
+static void record_callback(gel_wheel_timer_t *timer, void *user, void *arg) {
+    (void)timer;
+    (void)user;
+    (void)arg;
+    if (fired < 8) {
+        fire_times[fired] = now;
+    }
+    fired++;
+}
+
+
+static void rearm_callback(gel_wheel_timer_t *timer, void *user, void *arg) {
+    record_callback(timer, user, arg);
+    gel_timer_wheel_activate(&wheel, timer, 200, now, rearm_callback, arg);
+}
+
+
+void test_periodic_several_ticks_per_pass() {
+    gel_wheel_timer_t timer = GEL_WHEEL_TIMER_NULL;
+
+    gel_timer_wheel_activate(&wheel, &timer, 500, 0, record_callback, NULL);
+    gel_timer_wheel_set_period(&timer, 500);
+
+    // Three ticks go by between passes
+    for (now = 0; now < 4030; now += 30) {
+        gel_timer_wheel_manage_callbacks(&wheel, now, NULL);
+    }
+
+    TEST_ASSERT_EQUAL(8, fired);
+    for (int i = 0; i < 8; i++) {
+        TEST_ASSERT_UINT32_WITHIN(30, 500 * (i + 1) + 15, fire_times[i]);
+    }
+}
+
+
+void test_rearm_from_callback_several_ticks_per_pass() {
+    gel_wheel_timer_t timer = GEL_WHEEL_TIMER_NULL;
+
+    gel_timer_wheel_activate(&wheel, &timer, 200, 0, rearm_callback, NULL);
+
+    for (now = 0; now <= 1000; now += 30) {
+        gel_timer_wheel_manage_callbacks(&wheel, now, NULL);
+        // The main loop never finds a deadline that already passed
+        TEST_ASSERT_NOT_EQUAL(0, gel_timer_wheel_get_remaining(&wheel, now));
+    }
+
+    TEST_ASSERT_EQUAL(4, fired);
+    for (int i = 1; i < 4; i++) {
+        TEST_ASSERT_UINT32_WITHIN(30, 200, fire_times[i] - fire_times[i - 1]);
+    }
+}
@@ -22,5 +22,9 @@
 #define APP_CONFIG_MIN_STANDBY_BRIGHTNESS 0
 #define APP_CONFIG_MAX_STANDBY_BRIGHTNESS APP_CONFIG_MIN_NORMAL_BRIGHTNESS
 
+// Factory rate of the minions; faster rates are negotiated at startup
+#define APP_CONFIG_DEFAULT_BAUD_RATE 19200
+#define APP_CONFIG_MAX_BAUD_RATE     115200
+
 
 #endif
@@ -8,6 +8,9 @@
  * Page manager
  */
 #define PMAN_NAVIGATION_DEPTH 8
+// Hidden pages are budgeted by a rough estimate of the memory taken by their widgets, in bytes
+#define PMAN_RETAINED_PAGES 2
+#define PMAN_RETAIN_BUDGET  (16 * 1024)
 #define PMAN_VIEW_NULL
 #define PMAN_DATA_NULL NULL
 
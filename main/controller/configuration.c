@@ -1,25 +1,193 @@
+#include <assert.h>
+#include <string.h>
 #include "peripherals/storage.h"
+#include "configuration.h"
 #include "model/model.h"
+#include "gel/serializer/serializer.h"
+#include "gel/crc/crc32.h"
 #include "esp_log.h"
 
 
+/*
+ *  The whole configuration is stored as a single record:
+ *
+ *  | version (1) | payload length (2) | payload | crc32 of everything before (4) |
+ *
+ *  Fields are only ever appended to the payload, each new record version adding its own at the end. A record is
+ *  then readable by any firmware: older fields are a prefix of newer payloads and missing ones keep their defaults.
+ */
+#define CONFIGURATION_RECORD_KEY     "CONFIG"
+#define CONFIGURATION_RECORD_VERSION 1
+#define RECORD_HEADER_SIZE           3
+#define RECORD_CRC_SIZE              4
+#define RECORD_MAX_SIZE              256
+#define CRC_INIT                     0xFFFFFFFF
+
+#define PAYLOAD_V1_SIZE (MAX_FANS * 2 * 2 + 2 + 5 + 4 + 2 + MAX_FANS * MAX_FAN_NAME_LEN)
+
+
+typedef enum {
+    RECORD_LOADED = 0,
+    RECORD_MISSING,
+    RECORD_CORRUPTED,
+} record_result_t;
+
+
+static size_t          serialize_configuration(uint8_t *buffer, model_t *pmodel);
+static void            deserialize_configuration(model_t *pmodel, uint8_t *buffer, size_t len);
+static record_result_t load_record(model_t *pmodel);
+static void            load_legacy_keys(model_t *pmodel);
+
+
 static const char *TAG = "Configuration";
 
-const char *CONFIGURATION_MIN_SPEED_1_KEY        = "MINSPEED1";
-const char *CONFIGURATION_MIN_SPEED_2_KEY        = "MINSPEED2";
-const char *CONFIGURATION_MIN_SPEED_3_KEY        = "MINSPEED3";
-const char *CONFIGURATION_IMM_PERC_1_KEY         = "IMMPERC1";
-const char *CONFIGURATION_IMM_PERC_2_KEY         = "IMMPERC2";
-const char *CONFIGURATION_IMM_PERC_3_KEY         = "IMMPERC3";
-const char *CONFIGURATION_NUM_FANS_KEY           = "NUMFANS";
-const char *CONFIGURATION_IMMISSION_FAN_KEY      = "IMMFAN";
-const char *CONFIGURATION_NORMAL_BRIGHTNESS_KEY  = "NORMALB";
-const char *CONFIGURATION_STANDBY_BRIGHTNESS_KEY = "STANDBYB";
-const char *CONFIGURATION_LOGO_KEY               = "LOGO";
-const char *CONFIGURATION_GAS_KEY                = "GAS";
+// Keys used before the configuration record, only read to migrate old installations
+static const char *CONFIGURATION_MIN_SPEED_1_KEY        = "MINSPEED1";
+static const char *CONFIGURATION_MIN_SPEED_2_KEY        = "MINSPEED2";
+static const char *CONFIGURATION_MIN_SPEED_3_KEY        = "MINSPEED3";
+static const char *CONFIGURATION_IMM_PERC_1_KEY         = "IMMPERC1";
+static const char *CONFIGURATION_IMM_PERC_2_KEY         = "IMMPERC2";
+static const char *CONFIGURATION_IMM_PERC_3_KEY         = "IMMPERC3";
+static const char *CONFIGURATION_NUM_FANS_KEY           = "NUMFANS";
+static const char *CONFIGURATION_IMMISSION_FAN_KEY      = "IMMFAN";
+static const char *CONFIGURATION_NORMAL_BRIGHTNESS_KEY  = "NORMALB";
+static const char *CONFIGURATION_STANDBY_BRIGHTNESS_KEY = "STANDBYB";
+static const char *CONFIGURATION_LOGO_KEY               = "LOGO";
+static const char *CONFIGURATION_GAS_KEY                = "GAS";
+static const char *CONFIGURATION_BAUD_RATE_KEY          = "BAUDRATE";
 
 
 void configuration_load(model_t *pmodel) {
+    switch (load_record(pmodel)) {
+        case RECORD_LOADED:
+            model_check_config(pmodel);
+            break;
+
+        case RECORD_MISSING:
+            ESP_LOGI(TAG, "No configuration record, migrating from the old keys");
+            load_legacy_keys(pmodel);
+            model_check_config(pmodel);
+            configuration_save(pmodel);
+            break;
+
+        case RECORD_CORRUPTED:
+            // The legacy keys are older than the record that replaced them: the defaults are the safer guess
+            ESP_LOGE(TAG, "Invalid configuration record, using the defaults");
+            model_check_config(pmodel);
+            break;
+    }
+
+    ESP_LOGI(TAG, "Configuration loaded");
+}
+
+
+void configuration_save(model_t *pmodel) {
+    uint8_t buffer[RECORD_MAX_SIZE] = {0};
+
+    size_t payload_len = serialize_configuration(&buffer[RECORD_HEADER_SIZE], pmodel);
+    serialize_uint8(&buffer[0], CONFIGURATION_RECORD_VERSION);
+    serialize_uint16_be(&buffer[1], payload_len);
+
+    size_t   len = RECORD_HEADER_SIZE + payload_len;
+    uint32_t crc = crc32(buffer, len, CRC_INIT);
+    len += serialize_uint32_be(&buffer[len], crc);
+
+    storage_save_blob(buffer, len, (char *)CONFIGURATION_RECORD_KEY);
+}
+
+
+/*
+ *  A missing key leaves the buffer zeroed, which no record can be as the version starts from 1
+ */
+static record_result_t load_record(model_t *pmodel) {
+    uint8_t buffer[RECORD_MAX_SIZE] = {0};
+
+    if (storage_load_blob(buffer, sizeof(buffer), (char *)CONFIGURATION_RECORD_KEY)) {
+        return RECORD_CORRUPTED;
+    }
+
+    uint8_t  version     = 0;
+    uint16_t payload_len = 0;
+    uint32_t crc         = 0;
+    deserialize_uint8(&version, &buffer[0]);
+    deserialize_uint16_be(&payload_len, &buffer[1]);
+
+    if (version == 0 && payload_len == 0) {
+        return RECORD_MISSING;
+    } else if (version == 0 || (size_t)(RECORD_HEADER_SIZE + payload_len + RECORD_CRC_SIZE) > sizeof(buffer)) {
+        return RECORD_CORRUPTED;
+    }
+
+    deserialize_uint32_be(&crc, &buffer[RECORD_HEADER_SIZE + payload_len]);
+    if (crc != crc32(buffer, RECORD_HEADER_SIZE + payload_len, CRC_INIT)) {
+        return RECORD_CORRUPTED;
+    }
+
+    if (version > CONFIGURATION_RECORD_VERSION) {
+        ESP_LOGW(TAG, "Configuration record version %i is newer than %i, loading known fields only", version,
+                 CONFIGURATION_RECORD_VERSION);
+    }
+
+    deserialize_configuration(pmodel, &buffer[RECORD_HEADER_SIZE], payload_len);
+    return RECORD_LOADED;
+}
+
+
+static size_t serialize_configuration(uint8_t *buffer, model_t *pmodel) {
+    size_t i = 0;
+
+    // Version 1
+    for (size_t fan = 0; fan < MAX_FANS; fan++) {
+        i += serialize_uint16_be(&buffer[i], pmodel->configuration.minimum_speeds[fan]);
+        i += serialize_uint16_be(&buffer[i], pmodel->configuration.immission_percentages[fan]);
+    }
+    i += serialize_uint16_be(&buffer[i], pmodel->configuration.num_fans);
+    i += serialize_uint8(&buffer[i], pmodel->configuration.immission_fan);
+    i += serialize_uint8(&buffer[i], pmodel->configuration.normal_brightness);
+    i += serialize_uint8(&buffer[i], pmodel->configuration.standby_brightness);
+    i += serialize_uint8(&buffer[i], pmodel->configuration.logo);
+    i += serialize_uint8(&buffer[i], pmodel->configuration.gas_enabled);
+    i += serialize_uint32_be(&buffer[i], pmodel->configuration.baud_rate);
+    i += serialize_uint16_be(&buffer[i], pmodel->configuration.language);
+    for (size_t fan = 0; fan < MAX_FANS; fan++) {
+        memcpy(&buffer[i], pmodel->configuration.names[fan], MAX_FAN_NAME_LEN);
+        i += MAX_FAN_NAME_LEN;
+    }
+
+    assert(i == PAYLOAD_V1_SIZE);
+    return i;
+}
+
+
+static void deserialize_configuration(model_t *pmodel, uint8_t *buffer, size_t len) {
+    size_t i = 0;
+
+    if (len >= PAYLOAD_V1_SIZE) {
+        for (size_t fan = 0; fan < MAX_FANS; fan++) {
+            i += deserialize_uint16_be(&pmodel->configuration.minimum_speeds[fan], &buffer[i]);
+            i += deserialize_uint16_be(&pmodel->configuration.immission_percentages[fan], &buffer[i]);
+        }
+        i += deserialize_uint16_be(&pmodel->configuration.num_fans, &buffer[i]);
+        i += deserialize_uint8(&pmodel->configuration.immission_fan, &buffer[i]);
+        i += deserialize_uint8(&pmodel->configuration.normal_brightness, &buffer[i]);
+        i += deserialize_uint8(&pmodel->configuration.standby_brightness, &buffer[i]);
+        i += deserialize_uint8(&pmodel->configuration.logo, &buffer[i]);
+        i += deserialize_uint8(&pmodel->configuration.gas_enabled, &buffer[i]);
+        i += deserialize_uint32_be(&pmodel->configuration.baud_rate, &buffer[i]);
+        i += deserialize_uint16_be(&pmodel->configuration.language, &buffer[i]);
+        for (size_t fan = 0; fan < MAX_FANS; fan++) {
+            memcpy(pmodel->configuration.names[fan], &buffer[i], MAX_FAN_NAME_LEN);
+            pmodel->configuration.names[fan][MAX_FAN_NAME_LEN - 1] = '\0';
+            i += MAX_FAN_NAME_LEN;
+        }
+    }
+
+    // Fields added by later versions go here, each guarded by the payload length they require
+}
+
+
+static void load_legacy_keys(model_t *pmodel) {
+    storage_session_open();
     storage_load_uint16(&pmodel->configuration.minimum_speeds[0], (char *)CONFIGURATION_MIN_SPEED_1_KEY);
     storage_load_uint16(&pmodel->configuration.minimum_speeds[1], (char *)CONFIGURATION_MIN_SPEED_2_KEY);
     storage_load_uint16(&pmodel->configuration.minimum_speeds[2], (char *)CONFIGURATION_MIN_SPEED_3_KEY);
@@ -32,8 +200,6 @@ void configuration_load(model_t *pmodel) {
     storage_load_uint8(&pmodel->configuration.standby_brightness, (char *)CONFIGURATION_STANDBY_BRIGHTNESS_KEY);
     storage_load_uint8(&pmodel->configuration.logo, (char *)CONFIGURATION_LOGO_KEY);
     storage_load_uint8(&pmodel->configuration.gas_enabled, (char *)CONFIGURATION_GAS_KEY);
-
-    model_check_config(pmodel);
-
-    ESP_LOGI(TAG, "Configuration loaded");
+    storage_load_uint32(&pmodel->configuration.baud_rate, (char *)CONFIGURATION_BAUD_RATE_KEY);
+    storage_session_close();
 }
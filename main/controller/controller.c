@@ -14,8 +14,15 @@
 #include "esp_log.h"
 
 
+static void    negotiate_baud_rate(model_t *pmodel);
+static uint8_t configured_devices(model_t *pmodel);
+
+
 static const char *TAG = "Controller";
 
+static uint8_t negotiated_devices = 0;
+static int     negotiating        = 0;
+
 
 void controller_init(model_t *pmodel) {
     modbus_init();
@@ -24,6 +31,7 @@ void controller_init(model_t *pmodel) {
     configuration_load(pmodel);
     observer_init(pmodel);
     backlight_update(pmodel->configuration.normal_brightness);
+    negotiate_baud_rate(pmodel);
 
     view_change_page_extra(pmodel, &page_splash, (void *)(uintptr_t)0);
 
@@ -75,19 +83,34 @@ void controller_process_message(model_t *pmodel, view_controller_message_t *msg)
 }
 
 
-void controller_manage(model_t *pmodel) {
+/*
+ *  Returns the number of milliseconds until some deferred work is due
+ */
+uint32_t controller_manage(model_t *pmodel) {
     (void)pmodel;
     static uint8_t ap_started = 0;
 
     modbus_response_t response;
-    if (modbus_get_response(&response)) {
-        if (model_set_communication_error(pmodel, response.error)) {
+    while (modbus_get_response(&response)) {
+        if (response.tag == MODBUS_RESPONSE_TAG_HEALTH && response.address > 0 &&
+            model_set_device_health(pmodel, response.address - 1, response.health)) {
+            ESP_LOGI(TAG, "Device %i health %i", response.address, response.health);
+        }
+
+        // A parked device keeps the warning on even while the others answer
+        if (model_set_communication_error(pmodel, response.error || model_get_parked_devices(pmodel))) {
             ESP_LOGI(TAG, "Communication error %i", response.error);
-            view_event((view_event_t){.code = VIEW_EVENT_CODE_UPDATE});
         }
 
         switch (response.tag) {
             case MODBUS_RESPONSE_TAG_OK:
+            case MODBUS_RESPONSE_TAG_HEALTH:
+                break;
+
+            case MODBUS_RESPONSE_TAG_BAUD_RATE:
+                ESP_LOGI(TAG, "Bus running at %u baud", (unsigned)response.baud_rate);
+                pmodel->configuration.baud_rate = response.baud_rate;
+                negotiating                     = 0;
                 break;
 
             case MODBUS_RESPONSE_TAG_FIRMWARE_VERSION:
@@ -97,9 +120,23 @@ void controller_manage(model_t *pmodel) {
                     model_set_minion_firmware_version(pmodel, response.address, response.version_major,
                                                       response.version_minor, response.version_patch);
                 }
-                view_event((view_event_t){.code = VIEW_EVENT_CODE_UPDATE});
                 break;
 
+            case MODBUS_RESPONSE_TAG_MINION_UPDATE: {
+                char message[64] = {0};
+                if (response.error) {
+                    snprintf(message, sizeof(message), "Aggiornamento del dispositivo %i fallito!", response.address);
+                } else {
+                    snprintf(message, sizeof(message), "Dispositivo %i aggiornato", response.address);
+                }
+                view_common_toast(message);
+
+                if (response.remaining == 0) {
+                    server_minion_update_done();
+                }
+                break;
+            }
+
             case MODBUS_RESPONSE_TAG_START_OTA:
                 if (response.error) {
                     char message[64] = {0};
@@ -116,6 +153,12 @@ void controller_manage(model_t *pmodel) {
         }
     }
 
+    // A single refresh for everything the responses changed, limited to the affected widgets
+    uint32_t changes = model_take_changes(pmodel);
+    if (changes) {
+        view_event((view_event_t){.code = VIEW_EVENT_CODE_UPDATE, .changes = changes});
+    }
+
     observer_observe(pmodel);
 
     if (ap_started != network_is_ap_running()) {
@@ -123,10 +166,58 @@ void controller_manage(model_t *pmodel) {
         ap_started = network_is_ap_running();
     }
 
+    // Devices added or removed from the configuration have to join the bus at its current rate
+    if (!negotiating && configured_devices(pmodel) != negotiated_devices) {
+        negotiate_baud_rate(pmodel);
+    }
+
+    size_t   minion_image_size  = 0;
+    uint32_t minion_image_crc   = 0;
+    uint8_t  minion_device_mask = 0;
+    if (server_take_minion_update(&minion_image_size, &minion_image_crc, &minion_device_mask)) {
+        // Only the devices that are actually installed
+        minion_device_mask &= configured_devices(pmodel);
+        if (minion_device_mask == 0) {
+            view_common_toast("Nessun dispositivo da aggiornare");
+            server_minion_update_done();
+        } else if (modbus_update_minions(minion_image_size, minion_image_crc, minion_device_mask)) {
+            view_common_toast("Aggiornamento dei dispositivi non avviato!");
+            server_minion_update_done();
+        } else {
+            view_common_toast("Aggiornamento dei dispositivi in corso...");
+        }
+    }
+
     if (model_set_firmware_update_state(pmodel, server_firmware_update_state())) {
         if (model_get_firmware_update_state(pmodel) != FIRMWARE_UPDATE_STATE_NONE &&
             view_current_page_id() != PAGE_ID_FIRMWARE_UPDATE) {
             view_change_page(pmodel, &page_firmware_update);
         }
     }
+
+    return observer_get_idle_time();
+}
+
+
+/*
+ *  One negotiation at a time, so that the next one starts from the rate the previous one settled on
+ */
+static void negotiate_baud_rate(model_t *pmodel) {
+    uint8_t devices = configured_devices(pmodel);
+    if (modbus_negotiate_baud_rate(pmodel->configuration.baud_rate, devices) == 0) {
+        negotiated_devices = devices;
+        negotiating        = 1;
+    }
+}
+
+
+static uint8_t configured_devices(model_t *pmodel) {
+    uint8_t mask = 0;
+    for (size_t i = 0; i < pmodel->configuration.num_fans && i < MAX_FANS; i++) {
+        mask |= 1 << i;
+    }
+    if (pmodel->configuration.immission_fan) {
+        mask |= 1 << IMMISSION_FAN;
+    }
+    return mask;
 }
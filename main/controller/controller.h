@@ -5,8 +5,8 @@
 #include "view/view.h"
 
 
-void controller_init(model_t *model);
-void controller_process_message(model_t *pmodel, view_controller_message_t *msg);
-void controller_manage(model_t *pmodel);
+void     controller_init(model_t *model);
+void     controller_process_message(model_t *pmodel, view_controller_message_t *msg);
+uint32_t controller_manage(model_t *pmodel);
 
 #endif
\ No newline at end of file
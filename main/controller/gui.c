@@ -1,10 +1,12 @@
 #include "model/model.h"
 #include "view/view.h"
+#include "view/instrumentation.h"
 #include "controller.h"
 #include "esp_log.h"
 #include "gel/timer/timecheck.h"
 #include "utils/utils.h"
 #include "lvgl.h"
+#include "esp_timer.h"
 #include "peripherals/buzzer.h"
 // #include "standby.h"
 
@@ -12,7 +14,10 @@
 static const char *TAG = "Gui";
 
 
-void controller_gui_manage(model_t *pmodel) {
+/*
+ *  Returns the number of milliseconds until the next LVGL timer is due
+ */
+uint32_t controller_gui_manage(model_t *pmodel) {
     (void)TAG;
     static unsigned long last_invoked = 0;
     view_message_t       umsg;
@@ -25,7 +30,9 @@ void controller_gui_manage(model_t *pmodel) {
         last_invoked = get_millis();
     }
 
-    lv_timer_handler();
+    int64_t  start      = esp_timer_get_time();
+    uint32_t next_timer = lv_timer_handler();
+    instrumentation_record_handler(view_current_page_id(), (uint32_t)(esp_timer_get_time() - start));
 
     while (view_get_next_msg(pmodel, &umsg, &event)) {
         if (event.code == VIEW_EVENT_CODE_LVGL && (event.event == LV_EVENT_CLICKED)) {
@@ -36,4 +43,6 @@ void controller_gui_manage(model_t *pmodel) {
         controller_process_message(pmodel, &umsg.cmsg);
         view_process_msg(umsg.vmsg, pmodel);
     }
+
+    return next_timer;
 }
\ No newline at end of file
@@ -5,6 +5,6 @@
 #include "model/model.h"
 
 
-void controller_gui_manage(model_t *pmodel);
+uint32_t controller_gui_manage(model_t *pmodel);
 
 #endif
\ No newline at end of file
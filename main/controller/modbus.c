@@ -1,32 +1,76 @@
 #include <stdint.h>
+#include <string.h>
 #include <assert.h>
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "lightmodbus/lightmodbus.h"
 #include "modbus.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "peripherals/rs485.h"
+#include "peripherals/minion_image.h"
 #include "model/model.h"
+#include "utils/utils.h"
+#include "utils/wakeup.h"
+#include "gel/timer/timecheck.h"
+#include "gel/collections/queue.h"
+#include "config/app_config.h"
 
 
 #define MODBUS_RESPONSE_03_LEN(data_len) (5 + data_len * 2)
 #define MODBUS_RESPONSE_05_LEN           8
 #define MODBUS_MESSAGE_QUEUE_SIZE        32
 #define MODBUS_TIMEOUT                   25
+#define MODBUS_MIN_TIMEOUT               8
+#define MODBUS_MAX_TIMEOUT               200
+#define MODBUS_PARKED_PROBE_PERIOD       5000UL
 #define MODBUS_MAX_PACKET_SIZE           256
 #define MODBUS_COMMUNICATION_ATTEMPTS    5
+#define MODBUS_FUNCTION_UNSUPPORTED      2
+#define MODBUS_BROADCAST_ADDRESS         0
+#define MODBUS_BROADCAST_TURNAROUND      5
+
+#define MODBUS_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS 23
+#define MODBUS_EXCEPTION_FLAG                         0x80
+#define MODBUS_EXCEPTION_ILLEGAL_FUNCTION             1
 
 #define HOLDING_REGISTER_FAN                0
 #define HOLDING_REGISTER_RELAYS             1
 #define HOLDING_REGISTER_FIRMWARE_VERSION_1 2
 #define HOLDING_REGISTER_FIRMWARE_VERSION_2 3
+// Command code (modbus_group_command_t + 1, 0 means no command) followed by the mask of devices that should obey
+#define HOLDING_REGISTER_GROUP_COMMAND      16
+#define HOLDING_REGISTER_GROUP_MASK         17
+// Baud rate / 100; a new rate is provisional until confirmed at that same rate, otherwise the device reverts
+#define HOLDING_REGISTER_BAUD_RATE          18
+#define HOLDING_REGISTER_BAUD_RATE_CONFIRM  19
+// Firmware update relayed by the master: command (minion_update_command_t) followed by the size and the crc32 of the
+// image, high word first
+#define HOLDING_REGISTER_UPDATE_COMMAND     32
+// Offset of the next byte of the image the device expects, high word first
+#define HOLDING_REGISTER_UPDATE_ACK         37
+// Broadcast only: address of the device being updated, offset (high word first) and data, two bytes per register
+#define HOLDING_REGISTER_UPDATE_BLOCK       40
 #define HOLDING_REGISTER_ADDRESS            65033
 
+#define MODBUS_BAUD_RATE_REVERT_TIMEOUT 1000
+
+#define MODBUS_UPDATE_BLOCK_SIZE     240     // The largest that fits a write multiple registers request
+#define MODBUS_UPDATE_WINDOW         8
+#define MODBUS_UPDATE_TIMEOUT        1000
+#define MODBUS_UPDATE_FINISH_TIMEOUT 5000
+
+typedef enum {
+    MINION_UPDATE_COMMAND_BEGIN = 1,
+    MINION_UPDATE_COMMAND_FINISH,
+    MINION_UPDATE_COMMAND_ABORT,
+} minion_update_command_t;
+
 typedef enum {
-    TASK_MESSAGE_TAG_SET_SPEED,
-    TASK_MESSAGE_TAG_SET_LIGHT,
     TASK_MESSAGE_TAG_SET_ADDRESS,
-    TASK_MESSAGE_TAG_READ_FW_VERSION,
+    TASK_MESSAGE_TAG_NEGOTIATE_BAUD_RATE,
+    TASK_MESSAGE_TAG_UPDATE_MINIONS,
 } task_message_tag_t;
 
 
@@ -35,13 +79,13 @@ struct __attribute__((packed)) task_message {
     union {
         uint8_t address;
         struct {
-            uint16_t fan;
-            uint16_t speed;
-            uint16_t gas;
+            uint32_t baud_rate;
+            uint8_t  device_mask;
         };
         struct {
-            uint16_t light;
-            uint8_t  value;
+            uint32_t image_size;
+            uint32_t image_crc;
+            uint8_t  update_mask;
         };
     };
 };
@@ -53,61 +97,204 @@ typedef struct {
 } master_context_t;
 
 
+typedef enum {
+    DEVICE_PENDING_SPEED      = 0x01,
+    DEVICE_PENDING_LIGHT      = 0x02,
+    DEVICE_PENDING_FW_VERSION = 0x04,
+    DEVICE_PENDING_VERIFY     = 0x08,
+} device_pending_t;
+
+
+/*
+ *  Last-writer-wins mailbox shared between the producers and the Modbus task, one per device.
+ *  `updated` flags which registers were written since the task last collected the mailbox
+ */
+typedef struct {
+    uint8_t  updated;
+    uint16_t speed;
+    uint8_t  gas;
+    uint8_t  light;
+} device_mailbox_t;
+
+
+/*
+ *  Request slot for a single device, owned by the Modbus task. Only the latest value for each register is kept, so
+ *  a request that was superseded before it could reach the bus is never transmitted
+ */
+typedef struct {
+    uint8_t       pending;
+    uint16_t      speed;
+    uint16_t      relays;
+    uint8_t       attempts;
+    uint8_t       read_write_unsupported;
+    uint8_t       baud_rate_unsupported;
+    unsigned long retry_timestamp;
+
+    // Round-trip time estimation (RFC 6298), in microseconds; a zero `rto` means no sample was taken yet
+    device_health_t health;
+    uint32_t        srtt;
+    uint32_t        rttvar;
+    uint32_t        rto;
+} device_slot_t;
+
+
+/*
+ *  Requests go from the main task to the Modbus task and responses the other way around, each with a single producer
+ *  and a single consumer: lock free rings are enough and spare a kernel call per message
+ */
+SPSC_QUEUE_DECLARATION(message_queue, struct task_message, MODBUS_MESSAGE_QUEUE_SIZE);
+SPSC_QUEUE_DEFINITION(message_queue, struct task_message);
+SPSC_QUEUE_DECLARATION(response_queue, modbus_response_t, MODBUS_MESSAGE_QUEUE_SIZE);
+SPSC_QUEUE_DEFINITION(response_queue, modbus_response_t);
+
+
 static void        modbus_task(void *args);
+static void        store_message(ModbusMaster *master, device_slot_t *devices, struct task_message *message);
+static uint32_t    negotiate_baud_rate(ModbusMaster *master, device_slot_t *devices, uint32_t baud_rate,
+                                       uint8_t device_mask);
+static int         baud_rate_supported(ModbusMaster *master, device_slot_t *device, uint8_t address);
+static uint32_t    find_baud_rate(ModbusMaster *master, uint32_t tried, uint8_t device_mask);
+static int         devices_answer(ModbusMaster *master, uint32_t baud_rate, uint8_t device_mask);
+static int         try_baud_rate(ModbusMaster *master, uint32_t baud_rate, uint32_t candidate, uint8_t device_mask);
+static uint8_t     baud_rate_handshake(ModbusMaster *master, uint32_t baud_rate, uint32_t candidate,
+                                       uint8_t device_mask);
+static int         update_minion(ModbusMaster *master, uint8_t address, size_t size, uint32_t crc);
+static int         send_update_block(ModbusMaster *master, uint8_t address, size_t offset, size_t len);
+static uint8_t     write_to_devices(ModbusMaster *master, uint8_t device_mask, uint16_t reg, uint16_t value);
+static void        collect_mailboxes(ModbusMaster *master, device_slot_t *devices);
+static void        apply_group_command(ModbusMaster *master, device_slot_t *devices, modbus_group_command_t command,
+                                       uint8_t device_mask);
+static void        post_to_mailbox(uint16_t device, uint8_t updated, uint16_t speed, uint8_t gas, uint8_t light);
+static TickType_t  next_transaction_delay(device_slot_t *devices);
+static void        service_next_device(ModbusMaster *master, device_slot_t *devices, size_t *next_device);
+static void        run_device_transaction(ModbusMaster *master, device_slot_t *device, uint8_t address);
+static uint32_t    device_timeout(device_slot_t *device);
+static void        update_round_trip_time(device_slot_t *device, uint32_t sample);
+static void        set_device_health(device_slot_t *device, uint8_t address, device_health_t health);
+static void        send_response(modbus_response_t *response);
 static ModbusError exception_callback(const ModbusMaster *master, uint8_t address, uint8_t function,
                                       ModbusExceptionCode code);
 static ModbusError data_callback(const ModbusMaster *master, const ModbusDataCallbackArgs *args);
+static ModbusError request_allocator(ModbusBuffer *buffer, uint16_t size, void *context);
 static int write_holding_registers(ModbusMaster *master, uint8_t address, uint16_t starting_address, uint16_t *data,
-                                   size_t num);
+                                   size_t num, unsigned long timeout);
 static int read_holding_registers(ModbusMaster *master, uint16_t *registers, uint8_t address, uint16_t start,
-                                  uint16_t count);
+                                  uint16_t count, unsigned long timeout);
+static int read_write_holding_registers(uint8_t address, uint16_t *registers, uint16_t read_start,
+                                        uint16_t read_count, uint16_t write_start, uint16_t *data, uint16_t write_count,
+                                        unsigned long timeout);
+
+
+// Faster rates first
+static const uint32_t baud_rates[] = {115200, 57600, 38400};
+
+static const char       *TAG                                  = "Modbus";
+static SemaphoreHandle_t mailbox_sem                           = NULL;
+static TaskHandle_t      task                                  = NULL;
+static device_mailbox_t  mailboxes[MAX_DEVICES]                = {0};
+static uint8_t           group_masks[MODBUS_GROUP_COMMAND_NUM] = {0};
 
+static struct message_queue  messageq;
+static struct response_queue responseq;
 
-static const char   *TAG       = "Modbus";
-static QueueHandle_t messageq  = NULL;
-static QueueHandle_t responseq = NULL;
+// Only ever touched by the Modbus task, one transaction at a time
+static uint8_t request_buffer[MODBUS_MAX_PACKET_SIZE]  = {0};
+static uint8_t response_buffer[MODBUS_MAX_PACKET_SIZE] = {0};
+static uint8_t update_block[MODBUS_UPDATE_BLOCK_SIZE]  = {0};
+static uint8_t last_exception                          = 0;
 
 
 void modbus_init(void) {
-    static StaticQueue_t static_queue1;
-    static uint8_t       queue_buffer1[MODBUS_MESSAGE_QUEUE_SIZE * sizeof(struct task_message)] = {0};
-    messageq =
-        xQueueCreateStatic(MODBUS_MESSAGE_QUEUE_SIZE, sizeof(struct task_message), queue_buffer1, &static_queue1);
+    message_queue_init(&messageq);
+    response_queue_init(&responseq);
 
-    static StaticQueue_t static_queue2;
-    static uint8_t       queue_buffer2[MODBUS_MESSAGE_QUEUE_SIZE * sizeof(modbus_response_t)] = {0};
-    responseq = xQueueCreateStatic(MODBUS_MESSAGE_QUEUE_SIZE, sizeof(modbus_response_t), queue_buffer2, &static_queue2);
+    static StaticSemaphore_t mutex_buffer;
+    mailbox_sem = xSemaphoreCreateMutexStatic(&mutex_buffer);
 
-    xTaskCreate(modbus_task, TAG, 512 * 6, NULL, 5, NULL);
+    xTaskCreate(modbus_task, TAG, 512 * 6, NULL, 5, &task);
 }
 
 
 void modbus_set_speed(uint16_t fan, uint16_t speed, uint8_t gas) {
-    struct task_message msg = {.tag = TASK_MESSAGE_TAG_SET_SPEED, .fan = fan, .speed = speed, .gas = gas};
-    xQueueSend(messageq, &msg, portMAX_DELAY);
+    post_to_mailbox(fan, DEVICE_PENDING_SPEED, speed, gas, 0);
 }
 
 
 void modbus_set_light(uint16_t light, uint8_t value) {
-    struct task_message msg = {.tag = TASK_MESSAGE_TAG_SET_LIGHT, .light = light, .value = value};
-    xQueueSend(messageq, &msg, portMAX_DELAY);
+    post_to_mailbox(light, DEVICE_PENDING_LIGHT, 0, 0, value);
 }
 
 
 void modbus_set_address(uint8_t address) {
     struct task_message msg = {.tag = TASK_MESSAGE_TAG_SET_ADDRESS, .address = address};
-    xQueueSend(messageq, &msg, portMAX_DELAY);
+    if (message_queue_enqueue(&messageq, &msg) != ENQUEUE_RESULT_SUCCESS) {
+        ESP_LOGW(TAG, "Message queue full, address request dropped");
+        return;
+    }
+    xTaskNotifyGive(task);
+}
+
+
+/*
+ *  Returns -1 if the request could not be queued; a MODBUS_RESPONSE_TAG_BAUD_RATE response follows otherwise
+ */
+int modbus_negotiate_baud_rate(uint32_t baud_rate, uint8_t device_mask) {
+    struct task_message msg = {
+        .tag = TASK_MESSAGE_TAG_NEGOTIATE_BAUD_RATE, .baud_rate = baud_rate, .device_mask = device_mask};
+    if (message_queue_enqueue(&messageq, &msg) != ENQUEUE_RESULT_SUCCESS) {
+        ESP_LOGW(TAG, "Message queue full, baud rate negotiation dropped");
+        return -1;
+    }
+    xTaskNotifyGive(task);
+    return 0;
+}
+
+
+/*
+ *  Relays the image stored in minion_image to every device in the mask, one after the other. Returns -1 if the
+ *  request could not be queued; otherwise a MODBUS_RESPONSE_TAG_MINION_UPDATE response follows for each device
+ */
+int modbus_update_minions(size_t size, uint32_t crc, uint8_t device_mask) {
+    struct task_message msg = {
+        .tag = TASK_MESSAGE_TAG_UPDATE_MINIONS, .image_size = size, .image_crc = crc, .update_mask = device_mask};
+    if (message_queue_enqueue(&messageq, &msg) != ENQUEUE_RESULT_SUCCESS) {
+        ESP_LOGW(TAG, "Message queue full, minion update dropped");
+        return -1;
+    }
+    xTaskNotifyGive(task);
+    return 0;
 }
 
 
 void modbus_read_firmware_version(uint8_t address) {
-    struct task_message msg = {.tag = TASK_MESSAGE_TAG_READ_FW_VERSION, .address = address};
-    xQueueSend(messageq, &msg, portMAX_DELAY);
+    if (address > 0) {
+        post_to_mailbox(address - 1, DEVICE_PENDING_FW_VERSION, 0, 0, 0);
+    }
+}
+
+
+void modbus_group_command(modbus_group_command_t command, uint8_t device_mask) {
+    if (command >= MODBUS_GROUP_COMMAND_NUM) {
+        return;
+    }
+
+    xSemaphoreTake(mailbox_sem, portMAX_DELAY);
+    group_masks[command] |= device_mask;
+
+    // The group command supersedes whatever was still waiting for the same registers
+    for (size_t i = 0; i < MAX_DEVICES; i++) {
+        if (device_mask & (1 << i)) {
+            mailboxes[i].updated &= ~DEVICE_PENDING_SPEED;
+        }
+    }
+    xSemaphoreGive(mailbox_sem);
+
+    xTaskNotifyGive(task);
 }
 
 
 uint8_t modbus_get_response(modbus_response_t *response) {
-    return xQueueReceive(responseq, response, 0);
+    return response_queue_dequeue(&responseq, response) == DEQUEUE_RESULT_SUCCESS;
 }
 
 
@@ -117,102 +304,630 @@ static void modbus_task(void *args) {
     ModbusErrorInfo err = modbusMasterInit(&master,
                                            data_callback,              // Callback for handling incoming data
                                            exception_callback,         // Exception callback (optional)
-                                           modbusDefaultAllocator,     // Memory allocator used to allocate request
+                                           request_allocator,          // Memory allocator used to allocate request
                                            modbusMasterDefaultFunctions,        // Set of supported functions
                                            modbusMasterDefaultFunctionCount     // Number of supported functions
     );
 
     // Check for errors
     assert(modbusIsOk(err) && "modbusMasterInit() failed");
-    struct task_message message = {0};
+    struct task_message *message = NULL;
 
-    uint16_t relays[MAX_FANS] = {0};
+    device_slot_t devices[MAX_DEVICES] = {0};
+    size_t        next_device          = 0;
 
     ESP_LOGI(TAG, "Task starting");
 
     for (;;) {
-        if (xQueueReceive(messageq, &message, pdMS_TO_TICKS(100))) {
-            switch (message.tag) {
-                case TASK_MESSAGE_TAG_SET_SPEED: {
-                    modbus_response_t response = {.tag = MODBUS_RESPONSE_TAG_OK, .error = 0};
-                    uint8_t           address  = message.fan + 1;
+        ulTaskNotifyTake(pdTRUE, next_transaction_delay(devices));
 
-                    uint8_t gas_relay = message.gas ? (message.speed > 0) : 0;
-                    uint8_t relay     = 0;
-                    if (message.fan < MAX_FANS) {
-                        relays[message.fan] = (relays[message.fan] & (~0x02)) | (gas_relay ? 0x02 : 0x00);
-                        relay               = relays[message.fan];
-                    }
+        // Only the latest value posted for each register is collected; whatever was superseded is never transmitted
+        collect_mailboxes(&master, devices);
+        while ((message = message_queue_peek(&messageq)) != NULL) {
+            store_message(&master, devices, message);
+            message_queue_release(&messageq);
+        }
 
-                    uint16_t values[] = {message.speed, relay};
+        // A single transaction per pass, so that new requests are picked up between one device and the next
+        service_next_device(&master, devices, &next_device);
+    }
 
-                    ESP_LOGI(TAG, "Setting fan speed for %i to %i", message.fan, message.speed);
+    vTaskDelete(NULL);
+}
 
-                    if (write_holding_registers(&master, address, HOLDING_REGISTER_FAN, values, 2)) {
-                        response.error = 1;
-                    }
 
-                    xQueueSend(responseq, &response, portMAX_DELAY);
-                    break;
-                }
+static void post_to_mailbox(uint16_t device, uint8_t updated, uint16_t speed, uint8_t gas, uint8_t light) {
+    if (device >= MAX_DEVICES) {
+        return;
+    }
 
-                case TASK_MESSAGE_TAG_SET_LIGHT: {
-                    modbus_response_t response = {.tag = MODBUS_RESPONSE_TAG_OK, .error = 0};
+    // The mutex is only ever held for a handful of instructions, the producer is never stuck behind bus traffic
+    xSemaphoreTake(mailbox_sem, portMAX_DELAY);
+    device_mailbox_t *mailbox = &mailboxes[device];
+    if (updated & DEVICE_PENDING_SPEED) {
+        mailbox->speed = speed;
+        mailbox->gas   = gas;
+    }
+    if (updated & DEVICE_PENDING_LIGHT) {
+        mailbox->light = light;
+    }
+    mailbox->updated |= updated;
+    xSemaphoreGive(mailbox_sem);
 
-                    relays[message.light] = (relays[message.light] & (~0x01)) | (message.value ? 0x01 : 0x00);
-                    uint16_t values[]     = {relays[message.light]};
+    xTaskNotifyGive(task);
+}
 
-                    uint8_t address = message.light + 1;
 
-                    if (write_holding_registers(&master, address, HOLDING_REGISTER_RELAYS, values, 1)) {
-                        response.error = 1;
-                    }
-                    xQueueSend(responseq, &response, portMAX_DELAY);
-                    break;
-                }
+static void collect_mailboxes(ModbusMaster *master, device_slot_t *devices) {
+    device_mailbox_t snapshot[MAX_DEVICES];
+    uint8_t          group_snapshot[MODBUS_GROUP_COMMAND_NUM];
+
+    xSemaphoreTake(mailbox_sem, portMAX_DELAY);
+    memcpy(snapshot, mailboxes, sizeof(snapshot));
+    memcpy(group_snapshot, group_masks, sizeof(group_snapshot));
+    for (size_t i = 0; i < MAX_DEVICES; i++) {
+        mailboxes[i].updated = 0;
+    }
+    memset(group_masks, 0, sizeof(group_masks));
+    xSemaphoreGive(mailbox_sem);
+
+    // Group commands go first: any mailbox update still standing was posted after them
+    for (size_t i = 0; i < MODBUS_GROUP_COMMAND_NUM; i++) {
+        if (group_snapshot[i]) {
+            apply_group_command(master, devices, i, group_snapshot[i]);
+        }
+    }
+
+    for (size_t i = 0; i < MAX_DEVICES; i++) {
+        device_slot_t    *device  = &devices[i];
+        device_mailbox_t *mailbox = &snapshot[i];
+
+        if (mailbox->updated & DEVICE_PENDING_SPEED) {
+            uint8_t gas_relay = mailbox->gas ? (mailbox->speed > 0) : 0;
+            if (i < MAX_FANS) {
+                device->relays = (device->relays & (~0x02)) | (gas_relay ? 0x02 : 0x00);
+            }
+            device->speed = mailbox->speed;
+        }
+        if (mailbox->updated & DEVICE_PENDING_LIGHT) {
+            device->relays = (device->relays & (~0x01)) | (mailbox->light ? 0x01 : 0x00);
+        }
+        if ((mailbox->updated & DEVICE_PENDING_FW_VERSION) && device->health == DEVICE_HEALTH_PARKED) {
+            // No point in waiting for the next probe, the answer is known already
+            modbus_response_t response = {.tag = MODBUS_RESPONSE_TAG_FIRMWARE_VERSION, .address = i + 1, .error = 1};
+            send_response(&response);
+            mailbox->updated &= ~DEVICE_PENDING_FW_VERSION;
+        }
+        device->pending |= mailbox->updated;
+    }
+}
+
+
+/*
+ *  A broadcast is never answered, so every device involved is scheduled for a verification read; the ones that did
+ *  not obey are then corrected with an addressed write
+ */
+static void apply_group_command(ModbusMaster *master, device_slot_t *devices, modbus_group_command_t command,
+                                uint8_t device_mask) {
+    uint16_t values[] = {command + 1, device_mask};
+
+    ESP_LOGI(TAG, "Broadcasting group command %i to 0x%02X", command, device_mask);
+    ModbusErrorInfo err =
+        modbusBuildRequest16RTU(master, MODBUS_BROADCAST_ADDRESS, HOLDING_REGISTER_GROUP_COMMAND, 2, values);
+    assert(modbusIsOk(err));
+    rs485_flush();
+    rs485_write((uint8_t *)modbusMasterGetRequest(master), modbusMasterGetRequestLength(master));
+    // Leave the devices time to process the command before addressing any of them
+    vTaskDelay(pdMS_TO_TICKS(MODBUS_BROADCAST_TURNAROUND));
+
+    for (size_t i = 0; i < MAX_DEVICES; i++) {
+        if ((device_mask & (1 << i)) == 0) {
+            continue;
+        }
+
+        device_slot_t *device = &devices[i];
+        device->speed         = 0;
+        device->relays        = device->relays & (~0x02);
+        device->pending &= ~DEVICE_PENDING_SPEED;
+
+        // A pending speed write carries the relays as well, so it is kept as it stands
+        if ((device->pending & DEVICE_PENDING_SPEED) == 0) {
+            device->pending &= ~DEVICE_PENDING_LIGHT;
+        }
+        device->pending |= DEVICE_PENDING_VERIFY;
+    }
+}
+
 
-                case TASK_MESSAGE_TAG_SET_ADDRESS: {
-                    modbus_response_t response = {.tag = MODBUS_RESPONSE_TAG_OK, .error = 0};
-                    uint16_t          values[] = {message.address};
-
-                    if (write_holding_registers(&master, 0, HOLDING_REGISTER_ADDRESS, values, 1)) {
-                        response.error = 1;
-                    } else {
-                        vTaskDelay(pdMS_TO_TICKS(MODBUS_TIMEOUT / 2));
-                        uint16_t values[2] = {0};
-                        if (read_holding_registers(&master, values, message.address,
-                                                   HOLDING_REGISTER_FIRMWARE_VERSION_1, 2)) {
-                            response.error = 1;
-                        }
-                    }
-
-                    xQueueSend(responseq, &response, portMAX_DELAY);
-                    break;
+static void store_message(ModbusMaster *master, device_slot_t *devices, struct task_message *message) {
+    switch (message->tag) {
+        case TASK_MESSAGE_TAG_SET_ADDRESS: {
+            // Commissioning procedure; rare enough to be carried out on the spot
+            modbus_response_t response = {.tag = MODBUS_RESPONSE_TAG_OK, .error = 0};
+            uint16_t          values[] = {message->address};
+
+            if (write_holding_registers(master, 0, HOLDING_REGISTER_ADDRESS, values, 1, MODBUS_TIMEOUT)) {
+                response.error = 1;
+            } else {
+                // Give the device time to apply the new address
+                vTaskDelay(pdMS_TO_TICKS(MODBUS_TIMEOUT / 2));
+                uint16_t values[2] = {0};
+                if (read_holding_registers(master, values, message->address, HOLDING_REGISTER_FIRMWARE_VERSION_1, 2,
+                                           MODBUS_TIMEOUT)) {
+                    response.error = 1;
                 }
+            }
+
+            send_response(&response);
+            break;
+        }
 
-                case TASK_MESSAGE_TAG_READ_FW_VERSION: {
-                    modbus_response_t response = {.tag = MODBUS_RESPONSE_TAG_FIRMWARE_VERSION, .error = 0};
-                    response.address           = message.address;
-
-                    uint16_t values[2] = {0};
-                    if (read_holding_registers(&master, values, message.address, HOLDING_REGISTER_FIRMWARE_VERSION_1,
-                                               2)) {
-                        response.error = 1;
-                    } else {
-                        response.version_major = (values[0] >> 8) & 0xFF;
-                        response.version_minor = values[0] & 0xFF;
-                        response.version_patch = values[1] & 0xFF;
-                    }
-
-                    xQueueSend(responseq, &response, portMAX_DELAY);
-                    break;
+        case TASK_MESSAGE_TAG_NEGOTIATE_BAUD_RATE: {
+            modbus_response_t response = {.tag = MODBUS_RESPONSE_TAG_BAUD_RATE, .error = 0};
+
+            response.baud_rate = negotiate_baud_rate(master, devices, message->baud_rate, message->device_mask);
+            if (response.baud_rate == 0) {
+                response.error     = 1;
+                response.baud_rate = message->baud_rate;
+            }
+
+            // Round-trip times measured at the old rate no longer apply
+            for (size_t i = 0; i < MAX_DEVICES; i++) {
+                devices[i].rto = 0;
+            }
+
+            send_response(&response);
+            break;
+        }
+
+        case TASK_MESSAGE_TAG_UPDATE_MINIONS: {
+            // Maintenance procedure; the regular traffic waits until every device is done
+            uint8_t remaining = message->update_mask;
+
+            for (size_t i = 0; i < MAX_DEVICES; i++) {
+                if ((message->update_mask & (1 << i)) == 0) {
+                    continue;
                 }
+                remaining &= ~(1 << i);
+
+                modbus_response_t response = {.tag = MODBUS_RESPONSE_TAG_MINION_UPDATE, .address = i + 1};
+                response.error     = update_minion(master, i + 1, message->image_size, message->image_crc) != 0;
+                response.remaining = __builtin_popcount(remaining);
+                send_response(&response);
+
+                // The device restarts with the new firmware, which may support what the old one did not
+                devices[i].rto                   = 0;
+                devices[i].baud_rate_unsupported = 0;
             }
-            vTaskDelay(pdMS_TO_TICKS(MODBUS_TIMEOUT / 2));
+            break;
         }
     }
+}
 
-    vTaskDelete(NULL);
+
+/*
+ *  Brings every device to the bus rate (looking for the ones left at another rate, e.g. just installed or reset),
+ *  then tries to move all of them to a faster one. A device whose firmware cannot change rate holds the whole bus at
+ *  its own. Returns the rate in use at the end or 0 if no device could be reached at all
+ */
+static uint32_t negotiate_baud_rate(ModbusMaster *master, device_slot_t *devices, uint32_t baud_rate,
+                                    uint8_t device_mask) {
+    if (device_mask == 0) {
+        // Nothing to agree with; stay where a new device would be found
+        rs485_set_baud_rate(APP_CONFIG_DEFAULT_BAUD_RATE);
+        return APP_CONFIG_DEFAULT_BAUD_RATE;
+    }
+
+    uint8_t  reachable  = 0;
+    uint8_t  fixed      = 0;
+    uint32_t fixed_rate = 0;
+    for (size_t i = 0; i < MAX_DEVICES; i++) {
+        uint8_t device = 1 << i;
+        if ((device_mask & device) == 0) {
+            continue;
+        }
+
+        if (devices_answer(master, baud_rate, device)) {
+            reachable |= device;
+        } else {
+            uint32_t found = find_baud_rate(master, baud_rate, device);
+            if (found == 0) {
+                ESP_LOGW(TAG, "Device %zu unreachable", i + 1);
+            } else if (!baud_rate_supported(master, &devices[i], i + 1)) {
+                // It cannot be moved, so the others have to join it
+                ESP_LOGW(TAG, "Device %zu is stuck at %u baud", i + 1, (unsigned)found);
+                fixed |= device;
+                fixed_rate = found;
+            } else if (try_baud_rate(master, found, baud_rate, device)) {
+                ESP_LOGW(TAG, "Device %zu moved from %u baud", i + 1, (unsigned)found);
+                reachable |= device;
+            }
+            rs485_set_baud_rate(baud_rate);
+        }
+    }
+
+    if (fixed) {
+        if (reachable && !try_baud_rate(master, baud_rate, fixed_rate, reachable)) {
+            ESP_LOGW(TAG, "Could not bring the other devices to %u baud", (unsigned)fixed_rate);
+            return baud_rate;
+        }
+        rs485_set_baud_rate(fixed_rate);
+        return fixed_rate;
+    }
+
+    if (reachable == 0) {
+        ESP_LOGW(TAG, "Devices unreachable, keeping %u baud", (unsigned)baud_rate);
+        return 0;
+    }
+
+    for (size_t i = 0; i < MAX_DEVICES; i++) {
+        if ((reachable & (1 << i)) && !baud_rate_supported(master, &devices[i], i + 1)) {
+            ESP_LOGI(TAG, "Device %zu cannot change rate, staying at %u baud", i + 1, (unsigned)baud_rate);
+            return baud_rate;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(baud_rates) / sizeof(baud_rates[0]); i++) {
+        if (baud_rates[i] <= baud_rate || baud_rates[i] > APP_CONFIG_MAX_BAUD_RATE) {
+            continue;
+        }
+
+        if (try_baud_rate(master, baud_rate, baud_rates[i], reachable)) {
+            return baud_rates[i];
+        }
+    }
+
+    return baud_rate;
+}
+
+
+/*
+ *  Scans the default and every candidate rate except the one already tried; returns 0 if the devices answer at none
+ */
+static uint32_t find_baud_rate(ModbusMaster *master, uint32_t tried, uint8_t device_mask) {
+    if (tried != APP_CONFIG_DEFAULT_BAUD_RATE && devices_answer(master, APP_CONFIG_DEFAULT_BAUD_RATE, device_mask)) {
+        return APP_CONFIG_DEFAULT_BAUD_RATE;
+    }
+
+    for (size_t i = 0; i < sizeof(baud_rates) / sizeof(baud_rates[0]); i++) {
+        if (baud_rates[i] != tried && baud_rates[i] != APP_CONFIG_DEFAULT_BAUD_RATE &&
+            devices_answer(master, baud_rates[i], device_mask)) {
+            return baud_rates[i];
+        }
+    }
+
+    return 0;
+}
+
+
+static int devices_answer(ModbusMaster *master, uint32_t baud_rate, uint8_t device_mask) {
+    rs485_set_baud_rate(baud_rate);
+
+    for (size_t i = 0; i < MAX_DEVICES; i++) {
+        if ((device_mask & (1 << i)) == 0) {
+            continue;
+        }
+
+        uint16_t values[2] = {0};
+        int      res       = 1;
+        for (size_t attempt = 0; attempt < MODBUS_COMMUNICATION_ATTEMPTS && res; attempt++) {
+            res = read_holding_registers(master, values, i + 1, HOLDING_REGISTER_FIRMWARE_VERSION_1, 2,
+                                         MODBUS_TIMEOUT);
+        }
+        if (res) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+/*
+ *  Older firmware has no baud rate registers and answers their read with an exception. It is remembered for the
+ *  device, so that it does not cost a failed handshake (and the revert wait) every time
+ */
+static int baud_rate_supported(ModbusMaster *master, device_slot_t *device, uint8_t address) {
+    if (!device->baud_rate_unsupported) {
+        uint16_t value = 0;
+        int      res   = 1;
+        for (size_t attempt = 0; attempt < MODBUS_COMMUNICATION_ATTEMPTS && res; attempt++) {
+            last_exception = 0;
+            res = read_holding_registers(master, &value, address, HOLDING_REGISTER_BAUD_RATE, 1, MODBUS_TIMEOUT);
+        }
+
+        if (res == 0 && last_exception) {
+            ESP_LOGI(TAG, "Device %i does not support baud rate changes", address);
+            device->baud_rate_unsupported = 1;
+        }
+    }
+
+    return !device->baud_rate_unsupported;
+}
+
+
+/*
+ *  Moves the devices from `baud_rate` to `candidate`. Devices that missed the confirmation get a second chance; if
+ *  they still miss it the others are brought back, so that the bus is never left split between two rates
+ */
+static int try_baud_rate(ModbusMaster *master, uint32_t baud_rate, uint32_t candidate, uint8_t device_mask) {
+    ESP_LOGI(TAG, "Trying %u baud", (unsigned)candidate);
+
+    uint8_t missing = baud_rate_handshake(master, baud_rate, candidate, device_mask);
+    if (missing != 0 && missing != device_mask) {
+        ESP_LOGW(TAG, "Baud rate confirmation failed, retrying");
+        missing = baud_rate_handshake(master, baud_rate, candidate, missing);
+    }
+
+    if (missing == 0) {
+        return 1;
+    } else if (missing != device_mask &&
+               baud_rate_handshake(master, candidate, baud_rate, device_mask & ~missing) != 0) {
+        ESP_LOGE(TAG, "Devices split between %u and %u baud", (unsigned)baud_rate, (unsigned)candidate);
+    }
+
+    rs485_set_baud_rate(baud_rate);
+    return 0;
+}
+
+
+/*
+ *  Two phase handshake: every device is told the new rate, then the master switches and confirms it to each of them.
+ *  If anything goes wrong before the confirmation the devices revert on their own after
+ *  MODBUS_BAUD_RATE_REVERT_TIMEOUT. Returns the devices that did not end up at `candidate`
+ */
+static uint8_t baud_rate_handshake(ModbusMaster *master, uint32_t baud_rate, uint32_t candidate,
+                                   uint8_t device_mask) {
+    rs485_set_baud_rate(baud_rate);
+
+    if (write_to_devices(master, device_mask, HOLDING_REGISTER_BAUD_RATE, candidate / 100) != 0 ||
+        !devices_answer(master, candidate, device_mask)) {
+        rs485_set_baud_rate(baud_rate);
+        vTaskDelay(pdMS_TO_TICKS(MODBUS_BAUD_RATE_REVERT_TIMEOUT + MODBUS_TIMEOUT));
+        return device_mask;
+    }
+
+    uint8_t unconfirmed = write_to_devices(master, device_mask, HOLDING_REGISTER_BAUD_RATE_CONFIRM, candidate / 100);
+    if (unconfirmed) {
+        // Only the answer may have been lost; either way the device has settled once the revert timeout is over
+        vTaskDelay(pdMS_TO_TICKS(MODBUS_BAUD_RATE_REVERT_TIMEOUT + MODBUS_TIMEOUT));
+        for (size_t i = 0; i < MAX_DEVICES; i++) {
+            if ((unconfirmed & (1 << i)) && devices_answer(master, candidate, 1 << i)) {
+                unconfirmed &= ~(1 << i);
+            }
+        }
+    }
+
+    return unconfirmed;
+}
+
+
+/*
+ *  Returns the devices that did not acknowledge the write
+ */
+static uint8_t write_to_devices(ModbusMaster *master, uint8_t device_mask, uint16_t reg, uint16_t value) {
+    uint8_t failed = 0;
+
+    for (size_t i = 0; i < MAX_DEVICES; i++) {
+        if ((device_mask & (1 << i)) == 0) {
+            continue;
+        }
+
+        int res = 1;
+        for (size_t attempt = 0; attempt < MODBUS_COMMUNICATION_ATTEMPTS && res; attempt++) {
+            res = write_holding_registers(master, i + 1, reg, &value, 1, MODBUS_TIMEOUT);
+        }
+        if (res) {
+            failed |= 1 << i;
+        }
+    }
+
+    return failed;
+}
+
+
+static TickType_t next_transaction_delay(device_slot_t *devices) {
+    unsigned long now   = get_millis();
+    TickType_t    delay = portMAX_DELAY;
+
+    for (size_t i = 0; i < MAX_DEVICES; i++) {
+        if (devices[i].pending) {
+            if (time_after_or_equal(now, devices[i].retry_timestamp)) {
+                return 0;
+            }
+
+            TickType_t remaining = pdMS_TO_TICKS(devices[i].retry_timestamp - now);
+            if (remaining < delay) {
+                delay = remaining;
+            }
+        }
+    }
+
+    return delay;
+}
+
+
+static void service_next_device(ModbusMaster *master, device_slot_t *devices, size_t *next_device) {
+    unsigned long now = get_millis();
+
+    for (size_t i = 0; i < MAX_DEVICES; i++) {
+        size_t         index  = (*next_device + i) % MAX_DEVICES;
+        device_slot_t *device = &devices[index];
+
+        // Devices waiting for a retry are skipped, leaving the bus to the others in the meantime
+        if (device->pending == 0 || time_before(now, device->retry_timestamp)) {
+            continue;
+        }
+
+        *next_device = (index + 1) % MAX_DEVICES;
+        run_device_transaction(master, device, index + 1);
+        return;
+    }
+}
+
+
+static void run_device_transaction(ModbusMaster *master, device_slot_t *device, uint8_t address) {
+    uint16_t write_values[2] = {0};
+    uint16_t write_start     = 0;
+    uint16_t write_count     = 0;
+    uint16_t version[2]      = {0};
+    uint8_t  operation       = 0;
+    uint8_t  retried         = 0;
+    int      res             = 0;
+
+    uint32_t timeout = device_timeout(device);
+    int64_t  start   = esp_timer_get_time();
+
+    // Speed and relays are adjacent registers: whatever is pending among the two goes out with a single request
+    if (device->pending & DEVICE_PENDING_SPEED) {
+        operation       = DEVICE_PENDING_SPEED | DEVICE_PENDING_LIGHT;
+        write_start     = HOLDING_REGISTER_FAN;
+        write_values[0] = device->speed;
+        write_values[1] = device->relays;
+        write_count     = 2;
+        ESP_LOGI(TAG, "Setting fan speed for %i to %i", address - 1, device->speed);
+    } else if (device->pending & DEVICE_PENDING_LIGHT) {
+        operation       = DEVICE_PENDING_LIGHT;
+        write_start     = HOLDING_REGISTER_RELAYS;
+        write_values[0] = device->relays;
+        write_count     = 1;
+    }
+
+    if (write_count > 0 && (device->pending & DEVICE_PENDING_FW_VERSION) && !device->read_write_unsupported) {
+        // Status read piggybacked on the write, one round-trip instead of two
+        res = read_write_holding_registers(address, version, HOLDING_REGISTER_FIRMWARE_VERSION_1, 2, write_start,
+                                           write_values, write_count, timeout);
+        if (res == MODBUS_FUNCTION_UNSUPPORTED) {
+            // Older firmware; from now on this device is served with separate write and read requests
+            ESP_LOGI(TAG, "Device %i does not support combined read/write", address);
+            device->read_write_unsupported = 1;
+            return;
+        } else if (res && device->attempts == 0 &&
+                   write_holding_registers(master, address, write_start, write_values, write_count, timeout) == 0 &&
+                   read_holding_registers(master, version, address, HOLDING_REGISTER_FIRMWARE_VERSION_1, 2,
+                                          timeout) == 0) {
+            // Some firmware drops function 23 without an exception; only the separate requests tell it apart from
+            // a device that is not answering at all
+            ESP_LOGI(TAG, "Device %i ignores combined read/write", address);
+            device->read_write_unsupported = 1;
+            res                            = 0;
+            retried                        = 1;
+        }
+        operation |= DEVICE_PENDING_FW_VERSION;
+    } else if (write_count > 0) {
+        res = write_holding_registers(master, address, write_start, write_values, write_count, timeout);
+    } else if (device->pending & DEVICE_PENDING_FW_VERSION) {
+        operation = DEVICE_PENDING_FW_VERSION;
+        res       = read_holding_registers(master, version, address, HOLDING_REGISTER_FIRMWARE_VERSION_1, 2, timeout);
+    } else if (device->pending & DEVICE_PENDING_VERIFY) {
+        operation          = DEVICE_PENDING_VERIFY;
+        uint16_t values[2] = {0};
+        res                = read_holding_registers(master, values, address, HOLDING_REGISTER_FAN, 2, timeout);
+        if (!res && (values[0] != device->speed || values[1] != device->relays)) {
+            ESP_LOGW(TAG, "Device %i missed the group command, falling back to an addressed write", address);
+            device->pending |= DEVICE_PENDING_SPEED;
+        }
+    }
+
+    if (res) {
+        if (device->health == DEVICE_HEALTH_PARKED) {
+            // Failed probe, the device stays parked until the next one
+            device->retry_timestamp = get_millis() + MODBUS_PARKED_PROBE_PERIOD;
+            return;
+        }
+
+        if (++device->attempts < MODBUS_COMMUNICATION_ATTEMPTS) {
+            // Exponential backoff; the other devices are served while this one recovers
+            set_device_health(device, address, DEVICE_HEALTH_DEGRADED);
+            device->retry_timestamp = get_millis() + (MODBUS_TIMEOUT << (device->attempts - 1));
+            return;
+        }
+
+        // Circuit breaker: the device is only probed every now and then until it answers again. Writes are not
+        // repeated in the meantime, the verification read on return restores the latest state
+        ESP_LOGW(TAG, "Device %i did not answer after %i attempts, parking it", address, device->attempts);
+        set_device_health(device, address, DEVICE_HEALTH_PARKED);
+        device->retry_timestamp = get_millis() + MODBUS_PARKED_PROBE_PERIOD;
+        device->pending         = DEVICE_PENDING_VERIFY;
+        operation &= ~DEVICE_PENDING_VERIFY;
+    } else {
+        // Karn's algorithm: retransmitted requests give ambiguous samples
+        if (device->attempts == 0 && !retried && device->health == DEVICE_HEALTH_OK) {
+            update_round_trip_time(device, (uint32_t)(esp_timer_get_time() - start));
+        }
+        set_device_health(device, address, DEVICE_HEALTH_OK);
+        device->pending &= ~operation;
+    }
+
+    device->attempts = 0;
+
+    if (operation & (DEVICE_PENDING_SPEED | DEVICE_PENDING_LIGHT | DEVICE_PENDING_VERIFY)) {
+        modbus_response_t response = {.tag = MODBUS_RESPONSE_TAG_OK, .address = address, .error = res};
+        send_response(&response);
+    }
+    if (operation & DEVICE_PENDING_FW_VERSION) {
+        modbus_response_t response = {.tag = MODBUS_RESPONSE_TAG_FIRMWARE_VERSION, .address = address, .error = res};
+        if (!res) {
+            response.version_major = (version[0] >> 8) & 0xFF;
+            response.version_minor = version[0] & 0xFF;
+            response.version_patch = version[1] & 0xFF;
+        }
+        send_response(&response);
+    }
+}
+
+
+/*
+ *  Response timeout in milliseconds, doubled for every failed attempt
+ */
+static uint32_t device_timeout(device_slot_t *device) {
+    uint32_t timeout = MODBUS_TIMEOUT;
+
+    if (device->rto > 0) {
+        timeout = (device->rto + 999) / 1000;
+    }
+    timeout <<= device->attempts;
+
+    if (timeout < MODBUS_MIN_TIMEOUT) {
+        return MODBUS_MIN_TIMEOUT;
+    } else if (timeout > MODBUS_MAX_TIMEOUT) {
+        return MODBUS_MAX_TIMEOUT;
+    } else {
+        return timeout;
+    }
+}
+
+
+static void update_round_trip_time(device_slot_t *device, uint32_t sample) {
+    if (device->rto == 0) {
+        device->srtt   = sample;
+        device->rttvar = sample / 2;
+    } else {
+        uint32_t delta = device->srtt > sample ? device->srtt - sample : sample - device->srtt;
+        // RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R
+        device->rttvar = (3 * device->rttvar + delta) / 4;
+        device->srtt   = (7 * device->srtt + sample) / 8;
+    }
+    device->rto = device->srtt + 4 * device->rttvar;
+}
+
+
+static void set_device_health(device_slot_t *device, uint8_t address, device_health_t health) {
+    if (device->health != health) {
+        device->health             = health;
+        modbus_response_t response = {.tag = MODBUS_RESPONSE_TAG_HEALTH, .address = address, .health = health};
+        send_response(&response);
+    }
+}
+
+
+static void send_response(modbus_response_t *response) {
+    while (response_queue_enqueue(&responseq, response) != ENQUEUE_RESULT_SUCCESS) {
+        // The main loop is lagging behind; make sure it is awake and give it time to catch up
+        wakeup_notify();
+        vTaskDelay(1);
+    }
+    wakeup_notify();
 }
 
 
@@ -251,50 +966,129 @@ static ModbusError data_callback(const ModbusMaster *master, const ModbusDataCal
 }
 
 
+/*
+ *  Requests are always built in the same static buffer, no heap allocation takes place on the control path
+ */
+static ModbusError request_allocator(ModbusBuffer *buffer, uint16_t size, void *context) {
+    (void)context;
+
+    if (size == 0) {
+        buffer->data = NULL;
+        return MODBUS_OK;
+    } else if (size > sizeof(request_buffer)) {
+        buffer->data = NULL;
+        return MODBUS_ERROR_ALLOC;
+    } else {
+        buffer->data = request_buffer;
+        return MODBUS_OK;
+    }
+}
+
+
 static ModbusError exception_callback(const ModbusMaster *master, uint8_t address, uint8_t function,
                                       ModbusExceptionCode code) {
     ESP_LOGI(TAG, "Received exception (function %d) from slave %d code %d", function, address, code);
+    last_exception = code;
 
     return MODBUS_OK;
 }
 
 
-static int write_holding_registers(ModbusMaster *master, uint8_t address, uint16_t starting_address, uint16_t *data,
-                                   size_t num) {
-    uint8_t buffer[MODBUS_MAX_PACKET_SIZE] = {0};
-    int     res                            = 0;
-    size_t  counter                        = 0;
-
-    do {
-        res                 = 0;
-        ModbusErrorInfo err = modbusBuildRequest16RTU(master, address, starting_address, num, data);
-        assert(modbusIsOk(err));
-        rs485_flush();
-        rs485_write((uint8_t *)modbusMasterGetRequest(master), modbusMasterGetRequestLength(master));
-
-        int len = rs485_read(buffer, sizeof(buffer), pdMS_TO_TICKS(MODBUS_TIMEOUT));
-
-        size_t starting_index = 0;
-        if (len > 0) {
-            if (buffer[starting_index] == 0) {
-                len--;
-                starting_index++;
+/*
+ *  Broadcasts are never answered, so the image goes out in windows of blocks sent back to back, tagged with the
+ *  address of the device being updated. After each window the device reports the offset it expects next and the
+ *  transfer resumes from there, going back to the first block it missed
+ */
+static int update_minion(ModbusMaster *master, uint8_t address, size_t size, uint32_t crc) {
+    uint16_t begin[]  = {MINION_UPDATE_COMMAND_BEGIN, size >> 16, size & 0xFFFF, crc >> 16, crc & 0xFFFF};
+    uint16_t cancel[] = {MINION_UPDATE_COMMAND_ABORT};
+
+    ESP_LOGI(TAG, "Updating device %i (%zu bytes)", address, size);
+    if (write_holding_registers(master, address, HOLDING_REGISTER_UPDATE_COMMAND, begin, 5, MODBUS_UPDATE_TIMEOUT)) {
+        return -1;
+    }
+
+    size_t acknowledged = 0;
+    size_t attempts     = 0;
+    while (acknowledged < size) {
+        size_t offset = acknowledged;
+        for (size_t i = 0; i < MODBUS_UPDATE_WINDOW && offset < size; i++) {
+            size_t len = size - offset < MODBUS_UPDATE_BLOCK_SIZE ? size - offset : MODBUS_UPDATE_BLOCK_SIZE;
+            if (send_update_block(master, address, offset, len)) {
+                write_holding_registers(master, address, HOLDING_REGISTER_UPDATE_COMMAND, cancel, 1,
+                                        MODBUS_UPDATE_TIMEOUT);
+                return -1;
             }
+            offset += len;
         }
-        err = modbusParseResponseRTU(master, modbusMasterGetRequest(master), modbusMasterGetRequestLength(master),
-                                     &buffer[starting_index], len);
 
-        if (!modbusIsOk(err)) {
-            ESP_LOGW(TAG, "Write holding registers for %i error (%i): %i %i", address, len, err.source, err.error);
-            // ESP_LOG_BUFFER_HEX(TAG, (uint8_t *)buffer, len);
+        uint16_t ack[2] = {0};
+        size_t   next   = acknowledged;
+        if (read_holding_registers(master, ack, address, HOLDING_REGISTER_UPDATE_ACK, 2, MODBUS_UPDATE_TIMEOUT) == 0) {
+            next = ((uint32_t)ack[0] << 16) | ack[1];
+        }
 
-            res = 1;
-            vTaskDelay(pdMS_TO_TICKS(MODBUS_TIMEOUT));
+        if (next > acknowledged && next <= size) {
+            acknowledged = next;
+            attempts     = 0;
+        } else if (++attempts >= MODBUS_COMMUNICATION_ATTEMPTS) {
+            ESP_LOGW(TAG, "Update of device %i stuck at %zu", address, acknowledged);
+            write_holding_registers(master, address, HOLDING_REGISTER_UPDATE_COMMAND, cancel, 1, MODBUS_UPDATE_TIMEOUT);
+            return -1;
         }
-    } while (res && ++counter < MODBUS_COMMUNICATION_ATTEMPTS);
+    }
 
-    if (res) {
-        ESP_LOGW(TAG, "ERROR!");
+    // The device checks the image before answering
+    uint16_t finish[] = {MINION_UPDATE_COMMAND_FINISH};
+    return write_holding_registers(master, address, HOLDING_REGISTER_UPDATE_COMMAND, finish, 1,
+                                   MODBUS_UPDATE_FINISH_TIMEOUT);
+}
+
+
+static int send_update_block(ModbusMaster *master, uint8_t address, size_t offset, size_t len) {
+    uint16_t values[3 + MODBUS_UPDATE_BLOCK_SIZE / 2] = {address, offset >> 16, offset & 0xFFFF};
+    size_t   registers                                = (len + 1) / 2;
+
+    if (minion_image_read(offset, update_block, len)) {
+        ESP_LOGW(TAG, "Could not read the image at %zu", offset);
+        return -1;
+    }
+
+    // An odd last byte is padded; the device knows the size of the image
+    for (size_t i = 0; i < registers; i++) {
+        uint8_t low   = 2 * i + 1 < len ? update_block[2 * i + 1] : 0;
+        values[3 + i] = (update_block[2 * i] << 8) | low;
+    }
+
+    ModbusErrorInfo err = modbusBuildRequest16RTU(master, MODBUS_BROADCAST_ADDRESS, HOLDING_REGISTER_UPDATE_BLOCK,
+                                                  3 + registers, values);
+    assert(modbusIsOk(err));
+    rs485_write((uint8_t *)modbusMasterGetRequest(master), modbusMasterGetRequestLength(master));
+    return 0;
+}
+
+
+/*
+ *  Single attempt at each transaction; retries are scheduled by the task so that a silent device does not hold the
+ *  bus while the others wait
+ */
+static int write_holding_registers(ModbusMaster *master, uint8_t address, uint16_t starting_address, uint16_t *data,
+                                   size_t num, unsigned long timeout) {
+    int res = 0;
+
+    ModbusErrorInfo err = modbusBuildRequest16RTU(master, address, starting_address, num, data);
+    assert(modbusIsOk(err));
+    rs485_flush();
+    rs485_write((uint8_t *)modbusMasterGetRequest(master), modbusMasterGetRequestLength(master));
+
+    int len = rs485_receive_frame(response_buffer, sizeof(response_buffer), timeout);
+    err     = modbusParseResponseRTU(master, modbusMasterGetRequest(master), modbusMasterGetRequestLength(master),
+                                     response_buffer, len > 0 ? len : 0);
+
+    if (!modbusIsOk(err)) {
+        ESP_LOGW(TAG, "Write holding registers for %i error (%i): %i %i", address, len, err.source, err.error);
+        // ESP_LOG_BUFFER_HEX(TAG, response_buffer, len);
+        res = 1;
     } else {
         ESP_LOGI(TAG, "Success");
     }
@@ -304,11 +1098,9 @@ static int write_holding_registers(ModbusMaster *master, uint8_t address, uint16
 
 
 static int read_holding_registers(ModbusMaster *master, uint16_t *registers, uint8_t address, uint16_t start,
-                                  uint16_t count) {
+                                  uint16_t count, unsigned long timeout) {
     ModbusErrorInfo err;
-    int             res                            = 0;
-    size_t          counter                        = 0;
-    uint8_t         buffer[MODBUS_MAX_PACKET_SIZE] = {0};
+    int             res = 0;
 
     master_context_t ctx = {.pointer = registers, .start = start};
     if (registers == NULL) {
@@ -317,30 +1109,84 @@ static int read_holding_registers(ModbusMaster *master, uint16_t *registers, uin
         modbusMasterSetUserPointer(master, &ctx);
     }
 
-    do {
-        res = 0;
-        err = modbusBuildRequest03RTU(master, address, start, count);
-        assert(modbusIsOk(err));
+    err = modbusBuildRequest03RTU(master, address, start, count);
+    assert(modbusIsOk(err));
 
-        rs485_write((uint8_t *)modbusMasterGetRequest(master), modbusMasterGetRequestLength(master));
+    rs485_write((uint8_t *)modbusMasterGetRequest(master), modbusMasterGetRequestLength(master));
 
-        int    len            = rs485_read(buffer, sizeof(buffer), pdMS_TO_TICKS(MODBUS_TIMEOUT));
-        size_t starting_index = 0;
-        if (len > 0) {
-            if (buffer[starting_index] == 0) {
-                len--;
-                starting_index++;
-            }
-        }
-        err = modbusParseResponseRTU(master, modbusMasterGetRequest(master), modbusMasterGetRequestLength(master),
-                                     &buffer[starting_index], len);
+    int len = rs485_receive_frame(response_buffer, sizeof(response_buffer), timeout);
+    err     = modbusParseResponseRTU(master, modbusMasterGetRequest(master), modbusMasterGetRequestLength(master),
+                                     response_buffer, len > 0 ? len : 0);
 
-        if (!modbusIsOk(err)) {
-            ESP_LOGW(TAG, "Read holding registers for %i error (%i): %i %i", address, len, err.source, err.error);
-            res = 1;
-            vTaskDelay(pdMS_TO_TICKS(MODBUS_TIMEOUT));
-        }
-    } while (res && ++counter < MODBUS_COMMUNICATION_ATTEMPTS);
+    if (!modbusIsOk(err)) {
+        ESP_LOGW(TAG, "Read holding registers for %i error (%i): %i %i", address, len, err.source, err.error);
+        res = 1;
+    }
 
     return res;
 }
+
+
+/*
+ *  Read/Write Multiple Registers (function 23). liblightmodbus does not implement it on the master side, so the
+ *  frame is built and parsed here. Returns MODBUS_FUNCTION_UNSUPPORTED if the slave answers with an illegal
+ *  function exception
+ */
+static int read_write_holding_registers(uint8_t address, uint16_t *registers, uint16_t read_start,
+                                        uint16_t read_count, uint16_t write_start, uint16_t *data, uint16_t write_count,
+                                        unsigned long timeout) {
+    uint8_t *request = request_buffer;
+    size_t   i       = 0;
+
+    assert(13 + write_count * 2U <= sizeof(request_buffer) &&
+           MODBUS_RESPONSE_03_LEN(read_count * 1U) <= sizeof(response_buffer));
+
+    request[i++] = address;
+    request[i++] = MODBUS_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS;
+    request[i++] = (read_start >> 8) & 0xFF;
+    request[i++] = read_start & 0xFF;
+    request[i++] = (read_count >> 8) & 0xFF;
+    request[i++] = read_count & 0xFF;
+    request[i++] = (write_start >> 8) & 0xFF;
+    request[i++] = write_start & 0xFF;
+    request[i++] = (write_count >> 8) & 0xFF;
+    request[i++] = write_count & 0xFF;
+    request[i++] = write_count * 2;
+    for (size_t j = 0; j < write_count; j++) {
+        request[i++] = (data[j] >> 8) & 0xFF;
+        request[i++] = data[j] & 0xFF;
+    }
+    uint16_t crc = modbusCRC(request, i);
+    request[i++] = crc & 0xFF;
+    request[i++] = (crc >> 8) & 0xFF;
+
+    rs485_flush();
+    rs485_write(request, i);
+
+    int      len      = rs485_receive_frame(response_buffer, sizeof(response_buffer), timeout);
+    uint8_t *response = response_buffer;
+
+    if (len < 5 || response[0] != address ||
+        modbusCRC(response, len - 2) != (uint16_t)(response[len - 2] | (response[len - 1] << 8))) {
+        ESP_LOGW(TAG, "Read/write holding registers for %i error (%i)", address, len);
+        return 1;
+    }
+
+    if (response[1] == (MODBUS_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS | MODBUS_EXCEPTION_FLAG)) {
+        ESP_LOGI(TAG, "Received exception (function %d) from slave %d code %d",
+                 MODBUS_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS, address, response[2]);
+        return response[2] == MODBUS_EXCEPTION_ILLEGAL_FUNCTION ? MODBUS_FUNCTION_UNSUPPORTED : 1;
+    }
+
+    if (response[1] != MODBUS_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS || response[2] != read_count * 2 ||
+        len != MODBUS_RESPONSE_03_LEN(read_count)) {
+        ESP_LOGW(TAG, "Read/write holding registers for %i malformed response (%i)", address, len);
+        return 1;
+    }
+
+    for (size_t j = 0; j < read_count; j++) {
+        registers[j] = (response[3 + j * 2] << 8) | response[4 + j * 2];
+    }
+
+    return 0;
+}
@@ -3,12 +3,17 @@
 
 
 #include <stdint.h>
+#include <stdlib.h>
+#include "model/model.h"
 
 
 typedef enum {
     MODBUS_RESPONSE_TAG_OK,
     MODBUS_RESPONSE_TAG_FIRMWARE_VERSION,
     MODBUS_RESPONSE_TAG_START_OTA,
+    MODBUS_RESPONSE_TAG_HEALTH,
+    MODBUS_RESPONSE_TAG_BAUD_RATE,
+    MODBUS_RESPONSE_TAG_MINION_UPDATE,
 } modbus_response_tag_t;
 
 
@@ -22,16 +27,37 @@ typedef struct {
             uint16_t version_minor;
             uint16_t version_patch;
         };
+        device_health_t health;
+        uint32_t        baud_rate;
+        // Devices still to be updated after this one
+        uint8_t remaining;
     };
 } modbus_response_t;
 
 
+/*
+ *  Commands broadcast to every device at once; each one is obeyed only by the devices selected in the mask (bit 0 for
+ *  the first fan, address 1)
+ */
+typedef enum {
+    MODBUS_GROUP_COMMAND_FANS_OFF = 0,
+    MODBUS_GROUP_COMMAND_NUM,
+} modbus_group_command_t;
+
+
+/*
+ *  Requests and responses travel on single producer, single consumer queues: these functions are meant to be called
+ *  from the main task only
+ */
 void    modbus_init(void);
 void    modbus_set_speed(uint16_t fan, uint16_t speed, uint8_t gas);
 void    modbus_set_light(uint16_t light, uint8_t value);
 uint8_t modbus_get_response(modbus_response_t *response);
 void    modbus_read_firmware_version(uint8_t address);
 void    modbus_set_address(uint8_t address);
+void    modbus_group_command(modbus_group_command_t command, uint8_t device_mask);
+int     modbus_negotiate_baud_rate(uint32_t baud_rate, uint8_t device_mask);
+int     modbus_update_minions(size_t size, uint32_t crc, uint8_t device_mask);
 
 
 #endif
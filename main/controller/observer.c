@@ -2,24 +2,37 @@
 #include "configuration.h"
 #include "gel/data_structures/watcher.h"
 #include "gel/timer/timecheck.h"
-#include "peripherals/storage.h"
+#include "gel/timer/timer_wheel.h"
 #include "peripherals/backlight.h"
 #include "utils/utils.h"
 #include "modbus.h"
 #include "esp_log.h"
 
 
-#define NUM_OBSERVED_VARIABLES (15)
+#define NUM_OBSERVED_VARIABLES (1)
+#define SAVE_DELAY             4000UL
+#define FAN_SPEED_DEBOUNCE     500UL
 
 
-void update_brightness(void *mem, void *data);
+void        update_brightness(void *mem, void *data);
+void        schedule_configuration_save(void *mem, void *data);
+static void save_configuration(gel_wheel_timer_t *timer, void *user_pointer, void *arg);
+static void send_fan_speeds(gel_wheel_timer_t *timer, void *user_pointer, void *arg);
+static int  flush_fan_speeds(model_t *pmodel);
 
 
 static const char *TAG = "Observer";
 
-static watcher_t watchlist[NUM_OBSERVED_VARIABLES + 1] = {0};
-static uint16_t  old_fan_speeds[MAX_FANS]              = {0};
-static uint16_t  old_fan_on[MAX_FANS]                  = {0};
+static watcher_t        watchlist[NUM_OBSERVED_VARIABLES + 1]                = {0};
+static watcher_t        notifylist[MODEL_DIRTY_NUM]                          = {0};
+static watcher_bitmap_t notify_moved[WATCHER_BITMAP_WORDS(MODEL_DIRTY_NUM)] = {0};
+static uint16_t         old_fan_speeds[MAX_FANS]                             = {0};
+static uint16_t         old_fan_on[MAX_FANS]                                 = {0};
+
+// Every piece of deferred work of the observer hangs from here, so that the main loop knows when it is due
+static gel_timer_wheel_t wheel;
+static gel_wheel_timer_t save_timer      = GEL_WHEEL_TIMER_NULL;
+static gel_wheel_timer_t fan_speed_timer = GEL_WHEEL_TIMER_NULL;
 
 
 void observer_init(model_t *pmodel) {
@@ -29,69 +42,48 @@ void observer_init(model_t *pmodel) {
         old_fan_speeds[i] = model_get_fan_speed(pmodel, i);
     }
 
-    watchlist[i++] = WATCHER_DELAYED(&pmodel->configuration.minimum_speeds[0], storage_save_uint16,
-                                     CONFIGURATION_MIN_SPEED_1_KEY, 4000UL);
-    watchlist[i++] = WATCHER_DELAYED(&pmodel->configuration.minimum_speeds[1], storage_save_uint16,
-                                     CONFIGURATION_MIN_SPEED_2_KEY, 4000UL);
-    watchlist[i++] = WATCHER_DELAYED(&pmodel->configuration.minimum_speeds[2], storage_save_uint16,
-                                     CONFIGURATION_MIN_SPEED_3_KEY, 4000UL);
-    watchlist[i++] = WATCHER_DELAYED(&pmodel->configuration.immission_percentages[0], storage_save_uint16,
-                                     CONFIGURATION_IMM_PERC_1_KEY, 4000UL);
-    watchlist[i++] = WATCHER_DELAYED(&pmodel->configuration.immission_percentages[1], storage_save_uint16,
-                                     CONFIGURATION_IMM_PERC_2_KEY, 4000UL);
-    watchlist[i++] = WATCHER_DELAYED(&pmodel->configuration.immission_percentages[2], storage_save_uint16,
-                                     CONFIGURATION_IMM_PERC_3_KEY, 4000UL);
-    watchlist[i++] =
-        WATCHER_DELAYED(&pmodel->configuration.num_fans, storage_save_uint16, CONFIGURATION_NUM_FANS_KEY, 4000UL);
-    watchlist[i++] = WATCHER_DELAYED(&pmodel->configuration.immission_fan, storage_save_uint8,
-                                     CONFIGURATION_IMMISSION_FAN_KEY, 4000UL);
-    watchlist[i++] = WATCHER_DELAYED(&pmodel->configuration.normal_brightness, storage_save_uint8,
-                                     CONFIGURATION_NORMAL_BRIGHTNESS_KEY, 4000UL);
-    watchlist[i++] = WATCHER_DELAYED(&pmodel->configuration.standby_brightness, storage_save_uint8,
-                                     CONFIGURATION_STANDBY_BRIGHTNESS_KEY, 4000UL);
-    watchlist[i++] = WATCHER_DELAYED(&pmodel->configuration.logo, storage_save_uint8, CONFIGURATION_LOGO_KEY, 2000UL);
-    watchlist[i++] =
-        WATCHER_DELAYED(&pmodel->configuration.gas_enabled, storage_save_uint8, CONFIGURATION_GAS_KEY, 2000UL);
-    watchlist[i++] = WATCHER(&pmodel->configuration.normal_brightness, update_brightness, pmodel);
-    watchlist[i++] = WATCHER(&pmodel->configuration.standby_brightness, update_brightness, pmodel);
-    watchlist[i++] = WATCHER(&pmodel->run.standby, update_brightness, pmodel);
+    gel_timer_wheel_init(&wheel, get_millis());
+
+    // Any change to the configuration is saved as a whole record once it has settled
+    watchlist[i++] = WATCHER(&pmodel->configuration, schedule_configuration_save, pmodel);
 
     assert(NUM_OBSERVED_VARIABLES == i);
     watchlist[i++] = WATCHER_NULL;
 
     watcher_list_init(watchlist);
+
+    // Fields written through the model setters are flagged as they change instead of being compared each pass
+    notifylist[MODEL_DIRTY_NORMAL_BRIGHTNESS] =
+        WATCHER_NOTIFY(&pmodel->configuration.normal_brightness, update_brightness, pmodel);
+    notifylist[MODEL_DIRTY_STANDBY_BRIGHTNESS] =
+        WATCHER_NOTIFY(&pmodel->configuration.standby_brightness, update_brightness, pmodel);
+    notifylist[MODEL_DIRTY_STANDBY] = WATCHER_NOTIFY(&pmodel->run.standby, update_brightness, pmodel);
 }
 
 
 void observer_observe(model_t *pmodel) {
-    static unsigned long timestamp   = 0;
-    uint8_t              fan_changed = 0;
+    uint8_t fan_changed = 0;
 
     watcher_process_changes(watchlist, get_millis());
+    watcher_process_notified(notifylist, MODEL_DIRTY_NUM, pmodel->dirty, notify_moved, get_millis());
 
-    if (is_expired(timestamp, get_millis(), 500)) {
-        for (size_t i = 0; i < MAX_FANS; i++) {
-            if (old_fan_speeds[i] != model_get_fan_speed(pmodel, i)) {
-                if (model_get_fan_on(pmodel, i)) {
-                    modbus_set_speed(i, model_get_fan_speed(pmodel, i), pmodel->configuration.gas_enabled);
-                } else {
-                    modbus_set_speed(i, 0, pmodel->configuration.gas_enabled);
-                }
-                fan_changed = 1;
-
-                old_fan_speeds[i] = model_get_fan_speed(pmodel, i);
-            }
-        }
-
-        timestamp = get_millis();
+    // Speed changes are sent at most every FAN_SPEED_DEBOUNCE ms, while the user is still sliding: the first one goes
+    // out right away, whatever follows within the interval is sent when it expires
+    if (!gel_timer_wheel_is_active(&fan_speed_timer) && flush_fan_speeds(pmodel)) {
+        gel_timer_wheel_activate(&wheel, &fan_speed_timer, FAN_SPEED_DEBOUNCE, get_millis(), send_fan_speeds, NULL);
     }
 
+    gel_timer_wheel_manage_callbacks(&wheel, get_millis(), pmodel);
+
+    uint8_t turned_off = 0;
+    size_t  num_off    = 0;
     for (size_t i = 0; i < MAX_FANS; i++) {
         if (old_fan_on[i] != model_get_fan_on(pmodel, i)) {
             if (model_get_fan_on(pmodel, i)) {
                 modbus_set_speed(i, model_get_fan_speed(pmodel, i), pmodel->configuration.gas_enabled);
             } else {
-                modbus_set_speed(i, 0, pmodel->configuration.gas_enabled);
+                turned_off |= 1 << i;
+                num_off++;
             }
             fan_changed = 1;
 
@@ -99,8 +91,23 @@ void observer_observe(model_t *pmodel) {
         }
     }
 
-    if (pmodel->configuration.immission_fan && fan_changed) {
-        modbus_set_speed(IMMISSION_FAN, model_get_required_immission(pmodel), pmodel->configuration.gas_enabled);
+    uint16_t immission = model_get_required_immission(pmodel);
+    if (num_off > 1) {
+        // Several hoods switched off together: a single broadcast reaches all of them within one frame
+        if (pmodel->configuration.immission_fan && immission == 0) {
+            turned_off |= 1 << IMMISSION_FAN;
+        }
+        modbus_group_command(MODBUS_GROUP_COMMAND_FANS_OFF, turned_off);
+    } else {
+        for (size_t i = 0; i < MAX_FANS; i++) {
+            if (turned_off & (1 << i)) {
+                modbus_set_speed(i, 0, pmodel->configuration.gas_enabled);
+            }
+        }
+    }
+
+    if (pmodel->configuration.immission_fan && fan_changed && (turned_off & (1 << IMMISSION_FAN)) == 0) {
+        modbus_set_speed(IMMISSION_FAN, immission, pmodel->configuration.gas_enabled);
     }
 }
 
@@ -116,3 +123,63 @@ void update_brightness(void *mem, void *data) {
         backlight_update(pmodel->configuration.normal_brightness);
     }
 }
+
+
+/*
+ *  Returns the number of milliseconds until the observer has some deferred work to carry out
+ */
+uint32_t observer_get_idle_time(void) {
+    unsigned long remaining = gel_timer_wheel_get_remaining(&wheel, get_millis());
+    return remaining > UINT32_MAX ? UINT32_MAX : remaining;
+}
+
+
+void schedule_configuration_save(void *mem, void *data) {
+    (void)mem;
+    // Rearming moves the deadline further, so the save happens once the configuration stops changing
+    gel_timer_wheel_activate(&wheel, &save_timer, SAVE_DELAY, get_millis(), save_configuration, NULL);
+}
+
+
+static void save_configuration(gel_wheel_timer_t *timer, void *user_pointer, void *arg) {
+    (void)timer;
+    (void)arg;
+    configuration_save(user_pointer);
+}
+
+
+static void send_fan_speeds(gel_wheel_timer_t *timer, void *user_pointer, void *arg) {
+    (void)arg;
+
+    // Keep limiting the rate for as long as the speeds keep changing
+    if (flush_fan_speeds(user_pointer)) {
+        gel_timer_wheel_activate(&wheel, timer, FAN_SPEED_DEBOUNCE, get_millis(), send_fan_speeds, NULL);
+    }
+}
+
+
+/*
+ *  Sends the speeds that changed since the last time; returns whether there were any
+ */
+static int flush_fan_speeds(model_t *pmodel) {
+    uint8_t fan_changed = 0;
+
+    for (size_t i = 0; i < MAX_FANS; i++) {
+        if (old_fan_speeds[i] != model_get_fan_speed(pmodel, i)) {
+            if (model_get_fan_on(pmodel, i)) {
+                modbus_set_speed(i, model_get_fan_speed(pmodel, i), pmodel->configuration.gas_enabled);
+            } else {
+                modbus_set_speed(i, 0, pmodel->configuration.gas_enabled);
+            }
+            fan_changed = 1;
+
+            old_fan_speeds[i] = model_get_fan_speed(pmodel, i);
+        }
+    }
+
+    if (pmodel->configuration.immission_fan && fan_changed) {
+        modbus_set_speed(IMMISSION_FAN, model_get_required_immission(pmodel), pmodel->configuration.gas_enabled);
+    }
+
+    return fan_changed;
+}
@@ -2,11 +2,13 @@
 #define OBSERVER_H_INCLUDED
 
 
+#include <stdint.h>
 #include "model/model.h"
 
 
-void observer_init(model_t *pmodel);
-void observer_observe(model_t *pmodel);
+void     observer_init(model_t *pmodel);
+void     observer_observe(model_t *pmodel);
+uint32_t observer_get_idle_time(void);
 
 
 #endif
\ No newline at end of file
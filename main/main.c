@@ -27,6 +27,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include "config/app_config.h"
+#include "utils/wakeup.h"
+
+
+// Upper bound to the sleep time; every deadline is known, this is just a safety net
+#define MAX_IDLE_PERIOD 1000
 
 
 static const char *TAG = "Main";
@@ -48,6 +53,7 @@ const __attribute__((section(".rodata_custom_desc"))) struct {
 void app_main(void) {
     model_t model;
 
+    wakeup_init();
     backlight_init();
     storage_init();
     buzzer_init();
@@ -61,9 +67,13 @@ void app_main(void) {
 
     ESP_LOGI(TAG, "Begin main loop");
     for (;;) {
-        controller_gui_manage(&model);
-        controller_manage(&model);
+        uint32_t next_timer = controller_gui_manage(&model);
+        uint32_t next_work  = controller_manage(&model);
+        if (next_work < next_timer) {
+            next_timer = next_work;
+        }
 
-        vTaskDelay(pdMS_TO_TICKS(1));
+        // Sleep until the next LVGL timer or observer deadline is due, or something wakes the task up
+        wakeup_wait(next_timer < MAX_IDLE_PERIOD ? next_timer : MAX_IDLE_PERIOD);
     }
 }
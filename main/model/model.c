@@ -18,6 +18,7 @@ void model_init(model_t *pmodel) {
     pmodel->configuration.standby_brightness = 0;
     pmodel->configuration.gas_enabled        = 0;
     pmodel->configuration.logo               = LOGO_OLEARI;
+    pmodel->configuration.baud_rate          = APP_CONFIG_DEFAULT_BAUD_RATE;
 
     pmodel->run.communication_error   = 0;
     pmodel->run.firmware_update_state = FIRMWARE_UPDATE_STATE_NONE;
@@ -33,6 +34,13 @@ void model_init(model_t *pmodel) {
         pmodel->configuration.immission_percentages[i] = 30;
     }
 
+    for (size_t i = 0; i < MAX_DEVICES; i++) {
+        pmodel->run.device_health[i] = DEVICE_HEALTH_OK;
+    }
+
+    memset(pmodel->dirty, 0, sizeof(pmodel->dirty));
+    pmodel->changes = 0;
+
     check_immission_percentages(pmodel, -1);
 }
 
@@ -50,6 +58,8 @@ void model_check_config(model_t *pmodel) {
                      pmodel->configuration.minimum_speeds[i]);
     }
     CHECK_LIMITS(pmodel->configuration.num_fans, 1, MAX_FANS, 1);
+    CHECK_LIMITS(pmodel->configuration.baud_rate, APP_CONFIG_DEFAULT_BAUD_RATE, APP_CONFIG_MAX_BAUD_RATE,
+                 APP_CONFIG_DEFAULT_BAUD_RATE);
     CHECK_LIMITS(pmodel->configuration.normal_brightness, APP_CONFIG_MIN_NORMAL_BRIGHTNESS,
                  APP_CONFIG_MAX_NORMAL_BRIGHTNESS, APP_CONFIG_MAX_NORMAL_BRIGHTNESS);
     CHECK_LIMITS(pmodel->configuration.standby_brightness, APP_CONFIG_MIN_STANDBY_BRIGHTNESS,
@@ -78,6 +88,7 @@ void model_set_minion_firmware_version(model_t *pmodel, uint16_t minion, uint16_
     assert(pmodel != NULL && minion > 0);
     snprintf(pmodel->run.minion_firmware_version[minion - 1], sizeof(pmodel->run.minion_firmware_version[minion - 1]),
              "v%u.%u.%u", major, minor, patch);
+    pmodel->changes |= MODEL_CHANGE_FIRMWARE_VERSION;
 }
 
 
@@ -85,6 +96,42 @@ void model_set_minion_firmware_version_error(model_t *pmodel, uint16_t minion) {
     assert(pmodel != NULL && minion > 0);
     snprintf(pmodel->run.minion_firmware_version[minion - 1], sizeof(pmodel->run.minion_firmware_version[minion - 1]),
              "<error>");
+    pmodel->changes |= MODEL_CHANGE_FIRMWARE_VERSION;
+}
+
+
+uint8_t model_set_device_health(model_t *pmodel, size_t device, device_health_t health) {
+    assert(pmodel != NULL && device < MAX_DEVICES);
+    if (pmodel->run.device_health[device] != health) {
+        pmodel->run.device_health[device] = health;
+        pmodel->changes |= MODEL_CHANGE_COMMUNICATION;
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+
+uint8_t model_get_parked_devices(model_t *pmodel) {
+    assert(pmodel != NULL);
+    uint8_t mask = 0;
+    for (size_t i = 0; i < MAX_DEVICES; i++) {
+        if (pmodel->run.device_health[i] == DEVICE_HEALTH_PARKED) {
+            mask |= 1 << i;
+        }
+    }
+    return mask;
+}
+
+
+/*
+ *  Returns the groups of fields changed since the last call and clears them
+ */
+uint32_t model_take_changes(model_t *pmodel) {
+    assert(pmodel != NULL);
+    uint32_t changes = pmodel->changes;
+    pmodel->changes  = 0;
+    return changes;
 }
 
 
@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include "gel/data_structures/watcher.h"
 
 
 #define MAX_FANS         3
@@ -37,10 +38,44 @@
         pmodel->field = !pmodel->field;                                                                                \
     }
 
+#define NOTIFYING_SETTER(name, field, flag)                                                                            \
+    static inline __attribute__((always_inline))                                                                       \
+    uint8_t model_set_##name(model_t *pmodel, typeof(((model_t *)0)->field) value) {                                   \
+        assert(pmodel != NULL);                                                                                        \
+        if (pmodel->field != value) {                                                                                  \
+            pmodel->field = value;                                                                                     \
+            watcher_notify(pmodel->dirty, (flag));                                                                     \
+            return 1;                                                                                                  \
+        } else {                                                                                                       \
+            return 0;                                                                                                  \
+        }                                                                                                              \
+    }
+
+#define CHANGING_SETTER(name, field, change)                                                                           \
+    static inline __attribute__((always_inline))                                                                       \
+    uint8_t model_set_##name(model_t *pmodel, typeof(((model_t *)0)->field) value) {                                   \
+        assert(pmodel != NULL);                                                                                        \
+        if (pmodel->field != value) {                                                                                  \
+            pmodel->field = value;                                                                                     \
+            pmodel->changes |= (change);                                                                               \
+            return 1;                                                                                                  \
+        } else {                                                                                                       \
+            return 0;                                                                                                  \
+        }                                                                                                              \
+    }
+
 #define GETTERNSETTER(name, field)                                                                                     \
     GETTER(name, field)                                                                                                \
     SETTER(name, field)
 
+#define GETTERNSETTER_CHANGE(name, field, change)                                                                      \
+    GETTER(name, field)                                                                                                \
+    CHANGING_SETTER(name, field, change)
+
+#define GETTERNSETTER_NOTIFY(name, field, flag)                                                                        \
+    GETTER(name, field)                                                                                                \
+    NOTIFYING_SETTER(name, field, flag)
+
 
 typedef enum {
     FIRMWARE_UPDATE_STATE_NONE = 0,
@@ -50,6 +85,38 @@ typedef enum {
 } firmware_update_state_t;
 
 
+typedef enum {
+    DEVICE_HEALTH_OK = 0,
+    DEVICE_HEALTH_DEGRADED,
+    DEVICE_HEALTH_PARKED,
+} device_health_t;
+
+
+/*
+ * Fields that are only written through their setters; the setter flags them in `dirty` so that the observer
+ * does not have to compare them against a copy
+ */
+typedef enum {
+    MODEL_DIRTY_NORMAL_BRIGHTNESS = 0,
+    MODEL_DIRTY_STANDBY_BRIGHTNESS,
+    MODEL_DIRTY_STANDBY,
+    MODEL_DIRTY_NUM,
+} model_dirty_t;
+
+
+/*
+ * Groups of fields shown by the view. The ones written by the controller are collected in `changes` and forwarded
+ * with the UPDATE event, so that pages only refresh the widgets bound to them
+ */
+typedef enum {
+    MODEL_CHANGE_COMMUNICATION    = 0x01,
+    MODEL_CHANGE_FIRMWARE_VERSION = 0x02,
+    MODEL_CHANGE_FANS             = 0x04,
+} model_change_t;
+
+#define MODEL_CHANGE_ALL 0xFFFFFFFFUL
+
+
 typedef enum {
     LOGO_OLEARI,
     LOGO_HSW,
@@ -69,6 +136,7 @@ typedef struct {
         uint8_t  normal_brightness;
         uint8_t  standby_brightness;
         uint8_t  gas_enabled;
+        uint32_t baud_rate;
     } configuration;
 
     struct {
@@ -80,8 +148,12 @@ typedef struct {
 
         firmware_update_state_t firmware_update_state;
 
-        char minion_firmware_version[MAX_DEVICES][32];
+        char            minion_firmware_version[MAX_DEVICES][32];
+        device_health_t device_health[MAX_DEVICES];
     } run;
+
+    watcher_bitmap_t dirty[WATCHER_BITMAP_WORDS(MODEL_DIRTY_NUM)];
+    uint32_t         changes;
 } model_t;
 
 
@@ -107,9 +179,15 @@ uint16_t    model_get_minimum_speed(model_t *pmodel, uint16_t fan);
 void        model_set_minimum_speed(model_t *pmodel, uint16_t fan, uint16_t speed);
 void        model_turn_fan_off(model_t *pmodel, size_t fan);
 const char *model_get_fan_name(model_t *pmodel, size_t fan_index);
+uint8_t     model_set_device_health(model_t *pmodel, size_t device, device_health_t health);
+uint8_t     model_get_parked_devices(model_t *pmodel);
+uint32_t    model_take_changes(model_t *pmodel);
 
-GETTERNSETTER(communication_error, run.communication_error);
+GETTERNSETTER_CHANGE(communication_error, run.communication_error, MODEL_CHANGE_COMMUNICATION);
 GETTERNSETTER(firmware_update_state, run.firmware_update_state);
+GETTERNSETTER_NOTIFY(normal_brightness, configuration.normal_brightness, MODEL_DIRTY_NORMAL_BRIGHTNESS);
+GETTERNSETTER_NOTIFY(standby_brightness, configuration.standby_brightness, MODEL_DIRTY_STANDBY_BRIGHTNESS);
+GETTERNSETTER_NOTIFY(standby, run.standby, MODEL_DIRTY_STANDBY);
 
 
 #endif
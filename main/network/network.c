@@ -11,6 +11,7 @@
 #include "lwip/err.h"
 #include "lwip/sys.h"
 #include "server.h"
+#include "utils/wakeup.h"
 
 
 static const char *TAG = "Network";
@@ -31,10 +32,12 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
         ESP_LOGI(TAG, "Starting server");
         server_start();
         xEventGroupSetBits(event_group, EVENT_AP_STARTED);
+        wakeup_notify();
     } else if (event_id == WIFI_EVENT_AP_STOP) {
         ESP_LOGI(TAG, "Stopping server");
         server_stop();
         xEventGroupClearBits(event_group, EVENT_AP_STARTED);
+        wakeup_notify();
     }
 }
 
@@ -0,0 +1,242 @@
+#include <assert.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include "ota_writer.h"
+#include "ota_delta.h"
+
+
+/*
+ *  Applies a binary patch against the running application, writing the new image to the OTA writer as the patch
+ * comes in. The patch is made by tools/mkdelta.py out of a bsdiff: all fields are little endian and it starts with
+ *
+ *      "HSWD" | source size (4) | target size (4) | SHA256 of the source image (32)
+ *
+ *  followed by records of
+ *
+ *      diff length (4) | extra length (4) | seek (4, signed) | diff bytes | extra bytes
+ *
+ *  Diff bytes are added to the source at the current position, which then moves forward; extra bytes are copied
+ * as they are and the source position is moved by seek at the end of the record. Diff bytes are mostly zero, so the
+ * patch is meant to be sent gzip compressed.
+ */
+
+#define DELTA_MAGIC       "HSWD"
+#define DELTA_MAGIC_LEN   4
+#define DELTA_HEADER_SIZE (DELTA_MAGIC_LEN + 4 + 4 + 32)
+#define DELTA_RECORD_SIZE 12
+#define SOURCE_CHUNK_SIZE 512
+
+
+typedef enum {
+    STATE_HEADER = 0,
+    STATE_RECORD,
+    STATE_DIFF,
+    STATE_EXTRA,
+} delta_state_t;
+
+
+typedef struct {
+    const esp_partition_t *source;
+    uint8_t                source_chunk[SOURCE_CHUNK_SIZE];
+    size_t                 source_size;
+    size_t                 source_position;
+
+    delta_state_t state;
+    uint8_t       field[DELTA_HEADER_SIZE];
+    size_t        field_len;
+
+    size_t  diff_len;
+    size_t  extra_len;
+    int32_t seek;
+
+    size_t target_size;
+    size_t written;
+} delta_t;
+
+
+static esp_err_t parse_header(delta_t *delta);
+static esp_err_t parse_record(delta_t *delta);
+static esp_err_t apply_diff(delta_t *delta, const uint8_t *data, size_t len);
+static uint32_t  read_le32(const uint8_t *bytes);
+
+
+static const char *TAG = "OtaDelta";
+
+static delta_t *delta = NULL;
+
+
+int ota_delta_is_delta(const uint8_t *data, size_t len) {
+    return len > 0 && data[0] == DELTA_MAGIC[0];
+}
+
+
+size_t ota_delta_heap_size(void) {
+    return sizeof(delta_t);
+}
+
+
+esp_err_t ota_delta_begin(void) {
+    assert(delta == NULL);
+
+    delta = malloc(sizeof(delta_t));
+    if (delta == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(delta, 0, sizeof(delta_t));
+    delta->source = esp_ota_get_running_partition();
+    delta->state  = STATE_HEADER;
+
+    return ESP_OK;
+}
+
+
+/*
+ *  Returns ESP_ERR_INVALID_ARG if the patch is malformed or was not made for the running image, or the error of
+ * the writer
+ */
+esp_err_t ota_delta_feed(const uint8_t *data, size_t len) {
+    esp_err_t err = ESP_OK;
+
+    while (len > 0 && err == ESP_OK) {
+        size_t chunk = 0;
+
+        switch (delta->state) {
+            case STATE_HEADER:
+            case STATE_RECORD: {
+                size_t field_size = delta->state == STATE_HEADER ? DELTA_HEADER_SIZE : DELTA_RECORD_SIZE;
+
+                chunk = field_size - delta->field_len;
+                chunk = len < chunk ? len : chunk;
+                memcpy(&delta->field[delta->field_len], data, chunk);
+                delta->field_len += chunk;
+
+                if (delta->field_len == field_size) {
+                    delta->field_len = 0;
+                    err = delta->state == STATE_HEADER ? parse_header(delta) : parse_record(delta);
+                }
+                break;
+            }
+
+            case STATE_DIFF:
+                chunk = len < delta->diff_len ? len : delta->diff_len;
+                chunk = chunk < SOURCE_CHUNK_SIZE ? chunk : SOURCE_CHUNK_SIZE;
+                err   = apply_diff(delta, data, chunk);
+
+                delta->diff_len -= chunk;
+                if (delta->diff_len == 0) {
+                    delta->state = STATE_EXTRA;
+                }
+                break;
+
+            case STATE_EXTRA:
+                chunk = len < delta->extra_len ? len : delta->extra_len;
+                err   = ota_writer_write(data, chunk);
+
+                delta->written += chunk;
+                delta->extra_len -= chunk;
+                break;
+        }
+
+        data += chunk;
+        len -= chunk;
+
+        if (err == ESP_OK && delta->state == STATE_EXTRA && delta->extra_len == 0) {
+            // The seek can point anywhere, it only matters when the next diff starts
+            delta->source_position += delta->seek;
+            delta->state = STATE_RECORD;
+        }
+    }
+
+    return err;
+}
+
+
+/*
+ *  Releases the patcher; fails if the image was not complete
+ */
+esp_err_t ota_delta_end(void) {
+    if (delta == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int    complete = delta->state == STATE_RECORD && delta->field_len == 0 && delta->written == delta->target_size;
+    size_t written  = delta->written;
+
+    free(delta);
+    delta = NULL;
+
+    if (!complete) {
+        ESP_LOGW(TAG, "Truncated patch");
+        return ESP_ERR_INVALID_ARG;
+    } else {
+        ESP_LOGI(TAG, "Patched %zu bytes", written);
+        return ESP_OK;
+    }
+}
+
+
+static esp_err_t parse_header(delta_t *delta) {
+    if (memcmp(delta->field, DELTA_MAGIC, DELTA_MAGIC_LEN) != 0) {
+        ESP_LOGW(TAG, "Invalid patch header");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    delta->source_size = read_le32(&delta->field[DELTA_MAGIC_LEN]);
+    delta->target_size = read_le32(&delta->field[DELTA_MAGIC_LEN + 4]);
+
+    uint8_t sha256[32];
+    if (delta->source == NULL || delta->source_size > delta->source->size ||
+        esp_partition_get_sha256(delta->source, sha256) != ESP_OK ||
+        memcmp(sha256, &delta->field[DELTA_MAGIC_LEN + 8], sizeof(sha256)) != 0) {
+        ESP_LOGW(TAG, "The patch was not made for the running firmware");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ESP_LOGI(TAG, "Patching %zu bytes into %zu", delta->source_size, delta->target_size);
+    delta->state = STATE_RECORD;
+    return ESP_OK;
+}
+
+
+static esp_err_t parse_record(delta_t *delta) {
+    delta->diff_len  = read_le32(&delta->field[0]);
+    delta->extra_len = read_le32(&delta->field[4]);
+    delta->seek      = (int32_t)read_le32(&delta->field[8]);
+
+    if (delta->written + delta->diff_len + delta->extra_len > delta->target_size) {
+        ESP_LOGW(TAG, "Patch record past the end of the image");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    delta->state = delta->diff_len > 0 ? STATE_DIFF : STATE_EXTRA;
+    return ESP_OK;
+}
+
+
+static esp_err_t apply_diff(delta_t *delta, const uint8_t *data, size_t len) {
+    if (delta->source_position + len > delta->source_size) {
+        ESP_LOGW(TAG, "Patch reads past the end of the source (%zu)", delta->source_position);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = esp_partition_read(delta->source, delta->source_position, delta->source_chunk, len);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        delta->source_chunk[i] += data[i];
+    }
+
+    delta->source_position += len;
+    delta->written += len;
+    return ota_writer_write(delta->source_chunk, len);
+}
+
+
+static uint32_t read_le32(const uint8_t *bytes) {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
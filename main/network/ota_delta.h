@@ -0,0 +1,17 @@
+#ifndef OTA_DELTA_H_INCLUDED
+#define OTA_DELTA_H_INCLUDED
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <esp_err.h>
+
+
+int       ota_delta_is_delta(const uint8_t *data, size_t len);
+size_t    ota_delta_heap_size(void);
+esp_err_t ota_delta_begin(void);
+esp_err_t ota_delta_feed(const uint8_t *data, size_t len);
+esp_err_t ota_delta_end(void);
+
+
+#endif
@@ -0,0 +1,296 @@
+#include <assert.h>
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+#include "sdkconfig.h"
+#if CONFIG_IDF_TARGET_ESP32S2
+#include "esp32s2/rom/miniz.h"
+#else
+#include "esp32/rom/miniz.h"
+#endif
+#include "ota_inflate.h"
+
+
+/*
+ *  Streaming decompression of gzip (RFC 1952) firmware images, with the inflater in ROM.
+ *  The output goes through a circular window as large as the deflate dictionary, so memory use is bounded no matter
+ * the size of the image; the header is parsed a byte at a time, as it is only a few bytes long.
+ */
+
+#define GZIP_ID1     0x1F
+#define GZIP_ID2     0x8B
+#define GZIP_DEFLATE 8
+
+#define GZIP_FLAG_HCRC    0x02
+#define GZIP_FLAG_EXTRA   0x04
+#define GZIP_FLAG_NAME    0x08
+#define GZIP_FLAG_COMMENT 0x10
+
+#define GZIP_HEADER_SIZE  10
+#define GZIP_TRAILER_SIZE 8
+
+
+typedef enum {
+    STATE_HEADER = 0,
+    STATE_EXTRA_LENGTH,
+    STATE_EXTRA,
+    STATE_NAME,
+    STATE_COMMENT,
+    STATE_HEADER_CRC,
+    STATE_DATA,
+    STATE_TRAILER,
+    STATE_DONE,
+} inflate_state_t;
+
+
+typedef struct {
+    ota_inflate_output_t output;
+
+    tinfl_decompressor decompressor;
+    uint8_t            window[TINFL_LZ_DICT_SIZE];
+    size_t             window_offset;
+
+    inflate_state_t state;
+    uint8_t         flags;
+    uint8_t         field[GZIP_HEADER_SIZE];
+    size_t          field_len;
+    size_t          skip;
+
+    uint32_t crc;
+    uint32_t size;
+} inflate_t;
+
+
+static esp_err_t parse_header(inflate_t *inflate, uint8_t byte);
+static esp_err_t inflate_data(inflate_t *inflate, const uint8_t **data, size_t *len);
+static uint32_t  read_le32(const uint8_t *bytes);
+
+
+static const char *TAG = "OtaInflate";
+
+static inflate_t *inflate = NULL;
+
+
+/*
+ *  An ESP image starts with 0xE9, so the first byte is enough to tell the formats apart
+ */
+int ota_inflate_is_compressed(const uint8_t *data, size_t len) {
+    return len > 0 && data[0] == GZIP_ID1;
+}
+
+
+/*
+ *  Allocated as a single block by ota_inflate_begin, mostly the dictionary window
+ */
+size_t ota_inflate_heap_size(void) {
+    return sizeof(inflate_t);
+}
+
+
+/*
+ *  The inflated data is passed to `output` as it becomes available
+ */
+esp_err_t ota_inflate_begin(ota_inflate_output_t output) {
+    assert(inflate == NULL);
+
+    inflate = malloc(sizeof(inflate_t));
+    if (inflate == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    inflate->output = output;
+    tinfl_init(&inflate->decompressor);
+    inflate->window_offset = 0;
+    inflate->state         = STATE_HEADER;
+    inflate->flags         = 0;
+    inflate->field_len     = 0;
+    inflate->skip          = 0;
+    inflate->crc           = 0;
+    inflate->size          = 0;
+
+    return ESP_OK;
+}
+
+
+/*
+ *  Decompresses the next part of the stream. Returns ESP_ERR_INVALID_ARG if the stream is not a valid gzip file, or
+ * the error of the output.
+ */
+esp_err_t ota_inflate_feed(const uint8_t *data, size_t len) {
+    esp_err_t err = ESP_OK;
+
+    while (len > 0 && err == ESP_OK) {
+        switch (inflate->state) {
+            case STATE_DATA:
+                err = inflate_data(inflate, &data, &len);
+                break;
+
+            case STATE_TRAILER:
+                inflate->field[inflate->field_len++] = *data++;
+                len--;
+
+                if (inflate->field_len == GZIP_TRAILER_SIZE) {
+                    if (read_le32(&inflate->field[0]) != inflate->crc ||
+                        read_le32(&inflate->field[4]) != inflate->size) {
+                        ESP_LOGW(TAG, "Checksum mismatch on %u bytes", (unsigned)inflate->size);
+                        err = ESP_ERR_INVALID_ARG;
+                    } else {
+                        inflate->state = STATE_DONE;
+                    }
+                }
+                break;
+
+            case STATE_DONE:
+                // Anything after the first member is ignored
+                len = 0;
+                break;
+
+            default:
+                err = parse_header(inflate, *data++);
+                len--;
+                break;
+        }
+    }
+
+    return err;
+}
+
+
+/*
+ *  Releases the decompressor; fails if the stream was not complete
+ */
+esp_err_t ota_inflate_end(void) {
+    if (inflate == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    inflate_state_t state = inflate->state;
+    uint32_t        size  = inflate->size;
+
+    free(inflate);
+    inflate = NULL;
+
+    if (state != STATE_DONE) {
+        ESP_LOGW(TAG, "Truncated stream");
+        return ESP_ERR_INVALID_ARG;
+    } else {
+        ESP_LOGI(TAG, "Inflated %u bytes", (unsigned)size);
+        return ESP_OK;
+    }
+}
+
+
+static esp_err_t parse_header(inflate_t *inflate, uint8_t byte) {
+    switch (inflate->state) {
+        case STATE_HEADER:
+            inflate->field[inflate->field_len++] = byte;
+            if (inflate->field_len < GZIP_HEADER_SIZE) {
+                break;
+            }
+
+            if (inflate->field[0] != GZIP_ID1 || inflate->field[1] != GZIP_ID2 || inflate->field[2] != GZIP_DEFLATE) {
+                ESP_LOGW(TAG, "Invalid gzip header");
+                return ESP_ERR_INVALID_ARG;
+            }
+            inflate->flags     = inflate->field[3];
+            inflate->field_len = 0;
+            inflate->state     = STATE_EXTRA_LENGTH;
+            break;
+
+        case STATE_EXTRA_LENGTH:
+            if ((inflate->flags & GZIP_FLAG_EXTRA) == 0) {
+                inflate->state = STATE_NAME;
+                return parse_header(inflate, byte);
+            }
+
+            inflate->field[inflate->field_len++] = byte;
+            if (inflate->field_len == 2) {
+                inflate->skip      = inflate->field[0] | (inflate->field[1] << 8);
+                inflate->field_len = 0;
+                inflate->state     = inflate->skip > 0 ? STATE_EXTRA : STATE_NAME;
+            }
+            break;
+
+        case STATE_EXTRA:
+            if (--inflate->skip == 0) {
+                inflate->state = STATE_NAME;
+            }
+            break;
+
+        case STATE_NAME:
+            if ((inflate->flags & GZIP_FLAG_NAME) == 0 || byte == '\0') {
+                inflate->state = STATE_COMMENT;
+                if ((inflate->flags & GZIP_FLAG_NAME) == 0) {
+                    return parse_header(inflate, byte);
+                }
+            }
+            break;
+
+        case STATE_COMMENT:
+            if ((inflate->flags & GZIP_FLAG_COMMENT) == 0 || byte == '\0') {
+                inflate->state = STATE_HEADER_CRC;
+                inflate->skip  = 2;
+                if ((inflate->flags & GZIP_FLAG_COMMENT) == 0) {
+                    return parse_header(inflate, byte);
+                }
+            }
+            break;
+
+        case STATE_HEADER_CRC:
+            if ((inflate->flags & GZIP_FLAG_HCRC) == 0) {
+                inflate->state = STATE_DATA;
+                return inflate_data(inflate, &(const uint8_t *){&byte}, &(size_t){1});
+            } else if (--inflate->skip == 0) {
+                inflate->state = STATE_DATA;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return ESP_OK;
+}
+
+
+static esp_err_t inflate_data(inflate_t *inflate, const uint8_t **data, size_t *len) {
+    tinfl_status status;
+
+    do {
+        size_t in_bytes  = *len;
+        size_t out_bytes = TINFL_LZ_DICT_SIZE - inflate->window_offset;
+
+        status = tinfl_decompress(&inflate->decompressor, *data, &in_bytes, inflate->window,
+                                  &inflate->window[inflate->window_offset], &out_bytes, TINFL_FLAG_HAS_MORE_INPUT);
+        *data += in_bytes;
+        *len -= in_bytes;
+
+        if (out_bytes > 0) {
+            const uint8_t *output = &inflate->window[inflate->window_offset];
+
+            inflate->crc = esp_rom_crc32_le(inflate->crc, output, out_bytes);
+            inflate->size += out_bytes;
+            inflate->window_offset = (inflate->window_offset + out_bytes) & (TINFL_LZ_DICT_SIZE - 1);
+
+            esp_err_t err = inflate->output(output, out_bytes);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+
+        if (status < TINFL_STATUS_DONE) {
+            ESP_LOGW(TAG, "Corrupted stream (%i)", status);
+            return ESP_ERR_INVALID_ARG;
+        } else if (status == TINFL_STATUS_DONE) {
+            inflate->field_len = 0;
+            inflate->state     = STATE_TRAILER;
+            break;
+        }
+    } while (*len > 0 || status == TINFL_STATUS_HAS_MORE_OUTPUT);
+
+    return ESP_OK;
+}
+
+
+static uint32_t read_le32(const uint8_t *bytes) {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
@@ -0,0 +1,20 @@
+#ifndef OTA_INFLATE_H_INCLUDED
+#define OTA_INFLATE_H_INCLUDED
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <esp_err.h>
+
+
+typedef esp_err_t (*ota_inflate_output_t)(const uint8_t *data, size_t len);
+
+
+int       ota_inflate_is_compressed(const uint8_t *data, size_t len);
+size_t    ota_inflate_heap_size(void);
+esp_err_t ota_inflate_begin(ota_inflate_output_t output);
+esp_err_t ota_inflate_feed(const uint8_t *data, size_t len);
+esp_err_t ota_inflate_end(void);
+
+
+#endif
@@ -0,0 +1,205 @@
+#include <string.h>
+#include <assert.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <esp_ota_ops.h>
+#include <esp_spi_flash.h>
+#include <esp_log.h>
+#include "config/app_config.h"
+#include "ota_writer.h"
+
+
+/*
+ *  The image is collected in sector aligned buffers that a dedicated task writes to flash, while the other buffer is
+ * being filled. Writing whole sectors at a time keeps the number of flash operations low and sequential writes erase
+ * each sector right before it is written, so there is no long erase of the whole partition upfront.
+ */
+#define BUFFER_SIZE (4 * SPI_FLASH_SEC_SIZE)
+#define NUM_BUFFERS 2
+
+
+typedef struct {
+    uint8_t *data;
+    size_t   len;
+} block_t;
+
+
+static void writer_task(void *arg);
+static void drain(void);
+
+
+static const char *TAG = "OtaWriter";
+
+static QueueHandle_t full_queue = NULL;
+static QueueHandle_t free_queue = NULL;
+
+static uint8_t           *buffers[NUM_BUFFERS] = {0};
+static block_t            current              = {0};
+static esp_ota_handle_t   handle;
+static volatile esp_err_t write_error = ESP_OK;
+
+
+void ota_writer_init(void) {
+    static StaticQueue_t full_queue_buffer;
+    static StaticQueue_t free_queue_buffer;
+    static uint8_t       full_queue_storage[NUM_BUFFERS * sizeof(block_t)];
+    static uint8_t       free_queue_storage[NUM_BUFFERS * sizeof(block_t)];
+
+    full_queue = xQueueCreateStatic(NUM_BUFFERS, sizeof(block_t), full_queue_storage, &full_queue_buffer);
+    free_queue = xQueueCreateStatic(NUM_BUFFERS, sizeof(block_t), free_queue_storage, &free_queue_buffer);
+
+    // Above the HTTP server, so that a full buffer is taken over as soon as it is ready
+    xTaskCreate(writer_task, TAG, APP_CONFIG_TASK_SIZE * 6, NULL, 2, NULL);
+}
+
+
+size_t ota_writer_heap_size(void) {
+    return NUM_BUFFERS * BUFFER_SIZE;
+}
+
+
+esp_err_t ota_writer_begin(const esp_partition_t *partition) {
+    assert(current.data == NULL);
+
+    for (size_t i = 0; i < NUM_BUFFERS; i++) {
+        buffers[i] = malloc(BUFFER_SIZE);
+        if (buffers[i] == NULL) {
+            for (size_t j = 0; j < i; j++) {
+                free(buffers[j]);
+                buffers[j] = NULL;
+            }
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    esp_err_t err = esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &handle);
+    if (err != ESP_OK) {
+        for (size_t i = 0; i < NUM_BUFFERS; i++) {
+            free(buffers[i]);
+            buffers[i] = NULL;
+        }
+        return err;
+    }
+
+    write_error = ESP_OK;
+    xQueueReset(full_queue);
+    xQueueReset(free_queue);
+    for (size_t i = 1; i < NUM_BUFFERS; i++) {
+        block_t block = {.data = buffers[i], .len = 0};
+        xQueueSend(free_queue, &block, 0);
+    }
+    current = (block_t){.data = buffers[0], .len = 0};
+
+    return ESP_OK;
+}
+
+
+/*
+ *  Returns where the next `space` bytes of the image should be placed, to be confirmed with ota_writer_commit.
+ *  Received data can go straight into it with no further copies.
+ */
+uint8_t *ota_writer_reserve(size_t *space) {
+    assert(current.data != NULL);
+    *space = BUFFER_SIZE - current.len;
+    return &current.data[current.len];
+}
+
+
+/*
+ *  Confirms `len` bytes placed with ota_writer_reserve. Blocks only if the flash is slower than the producer and both
+ * buffers are waiting to be written; returns the error of any failed write.
+ */
+esp_err_t ota_writer_commit(size_t len) {
+    current.len += len;
+    assert(current.len <= BUFFER_SIZE);
+
+    if (current.len == BUFFER_SIZE) {
+        xQueueSend(full_queue, &current, portMAX_DELAY);
+        xQueueReceive(free_queue, &current, portMAX_DELAY);
+        current.len = 0;
+    }
+
+    return write_error;
+}
+
+
+esp_err_t ota_writer_write(const void *data, size_t len) {
+    const uint8_t *bytes = data;
+
+    while (len > 0) {
+        size_t   space;
+        uint8_t *buffer = ota_writer_reserve(&space);
+        size_t   chunk  = len < space ? len : space;
+
+        memcpy(buffer, bytes, chunk);
+        esp_err_t err = ota_writer_commit(chunk);
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        bytes += chunk;
+        len -= chunk;
+    }
+
+    return ESP_OK;
+}
+
+
+/*
+ *  Writes what is left, waits for the flash to be done and validates the image
+ */
+esp_err_t ota_writer_end(void) {
+    drain();
+
+    if (write_error != ESP_OK) {
+        esp_ota_abort(handle);
+        return write_error;
+    } else {
+        return esp_ota_end(handle);
+    }
+}
+
+
+void ota_writer_abort(void) {
+    // Anything still pending is pointless
+    write_error = ESP_FAIL;
+    drain();
+    esp_ota_abort(handle);
+}
+
+
+static void drain(void) {
+    xQueueSend(full_queue, &current, portMAX_DELAY);
+
+    // All buffers come back once the writer is idle
+    for (size_t i = 0; i < NUM_BUFFERS; i++) {
+        xQueueReceive(free_queue, &current, portMAX_DELAY);
+    }
+
+    for (size_t i = 0; i < NUM_BUFFERS; i++) {
+        free(buffers[i]);
+        buffers[i] = NULL;
+    }
+    current = (block_t){0};
+}
+
+
+static void writer_task(void *arg) {
+    (void)arg;
+    block_t block;
+
+    for (;;) {
+        xQueueReceive(full_queue, &block, portMAX_DELAY);
+
+        if (block.len > 0 && write_error == ESP_OK) {
+            esp_err_t err = esp_ota_write(handle, block.data, block.len);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "esp_ota_write failed (0x%04X)!", err);
+                write_error = err;
+            }
+        }
+
+        xQueueSend(free_queue, &block, portMAX_DELAY);
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef OTA_WRITER_H_INCLUDED
+#define OTA_WRITER_H_INCLUDED
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <esp_err.h>
+#include <esp_partition.h>
+
+
+void      ota_writer_init(void);
+size_t    ota_writer_heap_size(void);
+esp_err_t ota_writer_begin(const esp_partition_t *partition);
+uint8_t  *ota_writer_reserve(size_t *space);
+esp_err_t ota_writer_commit(size_t len);
+esp_err_t ota_writer_write(const void *data, size_t len);
+esp_err_t ota_writer_end(void);
+void      ota_writer_abort(void);
+
+
+#endif
@@ -1,24 +1,81 @@
+#include <stdio.h>
 #include <unistd.h>
 #include <esp_http_server.h>
 #include <esp_log.h>
 #include <cJSON.h>
 #include <esp_ota_ops.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
 #include "utils/utils.h"
+#include "utils/wakeup.h"
 #include "server.h"
+#include "ota_writer.h"
+#include "ota_inflate.h"
+#include "ota_delta.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 #include "model/model.h"
 #include "config/app_config.h"
+#include "view/view.h"
+#include "view/instrumentation.h"
+#include "gel/crc/crc32.h"
+#include "peripherals/minion_image.h"
+
+
+/*
+ *  Heap taken by an update, all of it at once for a compressed patch: the upload buffer (8 KB), the flash writer
+ * buffers (2 x 16 KB), the inflater (32 KB dictionary window plus about 11 KB of decoding tables, in one block) and
+ * the patcher (under 1 KB), about 85 KB overall. The display draw buffers (480 x CONFIG_APP_DISPLAY_BUFFER_LINES x 2
+ * bytes each, 37.5 KB with the default 40 lines) are allocated at boot, so the second one comes straight out of this
+ * margin: server_init logs how much is left.
+ */
+#define UPLOAD_BUFFER_SIZE 8192
+#define CHUNK_CRC_INIT     0xFFFFFFFF
+#define UPLOAD_TIMEOUT_US  (60LL * 1000 * 1000)
+
+
+typedef struct {
+    int                    active;
+    int                    compressed;     // -1 until the first bytes are in
+    int                    delta;          // -1 until the first decompressed bytes are in
+    size_t                 committed;
+    size_t                 size;
+    uint8_t               *buffer;
+    const esp_partition_t *partition;
+    int64_t                last_chunk;     // esp_timer_get_time() when the last chunk came in
+} upload_t;
 
 
 static esp_err_t firmware_update_put_handler(httpd_req_t *req);
+static esp_err_t firmware_update_chunk_put(httpd_req_t *req, const char *query);
+static esp_err_t firmware_update_get_handler(httpd_req_t *req);
+static esp_err_t minion_firmware_put_handler(httpd_req_t *req);
+static uint8_t   minion_update_running(void);
+static esp_err_t send_busy(httpd_req_t *req);
+static esp_err_t send_upload_status(httpd_req_t *req);
+static size_t    upload_heap_size(void);
+static esp_err_t upload_begin(size_t size);
+static esp_err_t upload_feed(const uint8_t *data, size_t len);
+static esp_err_t upload_output(const uint8_t *data, size_t len);
+static esp_err_t upload_commit(size_t len);
+static esp_err_t upload_finish(httpd_req_t *req);
+static esp_err_t upload_fail(httpd_req_t *req, esp_err_t err);
+static void      upload_abort(void);
+static void      upload_timer_callback(void *args);
+static void      upload_expire(void *args);
 static esp_err_t home_get_handler(httpd_req_t *req);
+static esp_err_t view_stats_get_handler(httpd_req_t *req);
 static void      set_firmware_update_state(firmware_update_state_t state);
 
 
 static const char *TAG               = "Server";
 static const char *MEMORY_ERR_STRING = "{\"error\":\"Could not allocate memory!\", \"code\":1}";
 static const char *INVALID_OTA       = "{\"error\":\"Invalid ota image!\", \"code\":4}";
+static const char *INVALID_CHUNK     = "{\"error\":\"Invalid chunk!\", \"code\":5}";
+static const char *CHUNK_CRC_ERR     = "{\"error\":\"Chunk checksum mismatch!\", \"code\":6}";
+static const char *INVALID_REQUEST   = "{\"error\":\"Invalid request!\", \"code\":7}";
+static const char *BUSY_ERR_STRING   = "{\"error\":\"Update in progress!\", \"code\":8}";
+static const char *OTA_MEMORY_ERR    = "{\"error\":\"Not enough memory for the update!\", \"code\":9}";
 
 
 static httpd_handle_t server = NULL;
@@ -27,10 +84,33 @@ static SemaphoreHandle_t sem = NULL;
 
 static firmware_update_state_t firmware_update = FIRMWARE_UPDATE_STATE_NONE;
 
+static upload_t upload = {0};
+
+static esp_timer_handle_t upload_timer = NULL;
+
+// Handed over to the controller once the image is stored, running until the last device is done
+static struct {
+    uint8_t  pending;
+    uint8_t  running;
+    size_t   size;
+    uint32_t crc;
+    uint8_t  device_mask;
+} minion_update = {0};
+
 
 void server_init(void) {
     static StaticSemaphore_t mutex_buffer;
     sem = xSemaphoreCreateMutexStatic(&mutex_buffer);
+    ota_writer_init();
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = upload_timer_callback,
+        .name     = "upload",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &upload_timer));
+
+    ESP_LOGI(TAG, "An update needs up to %zu bytes of heap, %zu free (largest block %zu)", upload_heap_size(),
+             heap_caps_get_free_size(MALLOC_CAP_8BIT), heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
 }
 
 
@@ -42,6 +122,27 @@ firmware_update_state_t server_firmware_update_state(void) {
 }
 
 
+uint8_t server_take_minion_update(size_t *size, uint32_t *crc, uint8_t *device_mask) {
+    xSemaphoreTake(sem, portMAX_DELAY);
+    uint8_t res = minion_update.pending;
+    if (res) {
+        *size                 = minion_update.size;
+        *crc                  = minion_update.crc;
+        *device_mask          = minion_update.device_mask;
+        minion_update.pending = 0;
+    }
+    xSemaphoreGive(sem);
+    return res;
+}
+
+
+void server_minion_update_done(void) {
+    xSemaphoreTake(sem, portMAX_DELAY);
+    minion_update.running = 0;
+    xSemaphoreGive(sem);
+}
+
+
 void server_start(void) {
     if (server != NULL) {
         return;
@@ -51,7 +152,7 @@ void server_start(void) {
     config.task_priority    = 1;
     config.stack_size       = APP_CONFIG_TASK_SIZE * 10;
     config.lru_purge_enable = true;
-    config.max_uri_handlers = 4;
+    config.max_uri_handlers = 6;
 
     /* Start the httpd server */
     ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
@@ -65,15 +166,39 @@ void server_start(void) {
             .handler = firmware_update_put_handler,
         };
 
+        // GET /firmware_update
+        const httpd_uri_t system_firmware_update_status = {
+            .uri     = (const char *)"/firmware_update",
+            .method  = HTTP_GET,
+            .handler = firmware_update_get_handler,
+        };
+
+        // PUT /minion_firmware
+        const httpd_uri_t minion_firmware = {
+            .uri     = (const char *)"/minion_firmware",
+            .method  = HTTP_PUT,
+            .handler = minion_firmware_put_handler,
+        };
+
         const httpd_uri_t home = {
             .uri     = (const char *)"/",
             .method  = HTTP_GET,
             .handler = home_get_handler,
         };
 
+        // GET /view_stats
+        const httpd_uri_t view_stats = {
+            .uri     = (const char *)"/view_stats",
+            .method  = HTTP_GET,
+            .handler = view_stats_get_handler,
+        };
+
         ESP_LOGI(TAG, "Registering URI handlers");
         httpd_register_uri_handler(server, &system_firmware_update);
+        httpd_register_uri_handler(server, &system_firmware_update_status);
+        httpd_register_uri_handler(server, &minion_firmware);
         httpd_register_uri_handler(server, &home);
+        httpd_register_uri_handler(server, &view_stats);
 
     } else {
         ESP_LOGW(TAG, "Error starting server (0x%03X)!", res);
@@ -102,47 +227,252 @@ static esp_err_t home_get_handler(httpd_req_t *req) {
 }
 
 
+/*
+ *  `GET /view_stats` returns the view event queue counters and the most recent rendering samples
+ */
+static esp_err_t view_stats_get_handler(httpd_req_t *req) {
+    static instrumentation_sample_t samples[32];
+    size_t                          num = instrumentation_get_samples(samples, sizeof(samples) / sizeof(samples[0]));
+    view_event_stats_t              event_stats;
+    view_get_event_stats(&event_stats);
+
+    cJSON *json   = cJSON_CreateObject();
+    cJSON *events = cJSON_AddObjectToObject(json, "events");
+    cJSON *array  = cJSON_AddArrayToObject(json, "samples");
+    if (json == NULL || events == NULL || array == NULL) {
+        cJSON_Delete(json);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, MEMORY_ERR_STRING);
+        return ESP_FAIL;
+    }
+
+    cJSON_AddNumberToObject(events, "dropped", event_stats.dropped);
+    cJSON_AddNumberToObject(events, "coalesced", event_stats.coalesced);
+    cJSON_AddNumberToObject(events, "depth", event_stats.depth);
+    cJSON_AddNumberToObject(events, "max_depth", event_stats.max_depth);
+
+    for (size_t i = 0; i < num; i++) {
+        cJSON *sample = cJSON_CreateObject();
+        if (sample == NULL) {
+            break;
+        }
+        cJSON_AddNumberToObject(sample, "timestamp", samples[i].timestamp);
+        cJSON_AddNumberToObject(sample, "duration", samples[i].duration);
+        cJSON_AddNumberToObject(sample, "page", samples[i].page_id);
+        cJSON_AddNumberToObject(sample, "frames", samples[i].frames);
+        cJSON_AddNumberToObject(sample, "handler_calls", samples[i].handler_calls);
+        cJSON_AddNumberToObject(sample, "handler_max_us", samples[i].handler_max_us);
+        cJSON_AddNumberToObject(sample, "handler_total_us", samples[i].handler_total_us);
+        cJSON_AddNumberToObject(sample, "refresh_max_ms", samples[i].refresh_max_ms);
+        cJSON_AddNumberToObject(sample, "flush_bytes", samples[i].flush_bytes);
+        cJSON_AddNumberToObject(sample, "mem_high_water", samples[i].mem_high_water);
+        cJSON_AddItemToArray(array, sample);
+    }
+
+    char *string = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+    if (string == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, MEMORY_ERR_STRING);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, string, HTTPD_RESP_USE_STRLEN);
+    free(string);
+    return ESP_OK;
+}
+
+
+/*
+ *  The image is either sent whole, or in chunks with `PUT /firmware_update?offset=N&size=S` (S being the size of the
+ * whole upload) and the crc32 of the chunk in hexadecimal in the X-Chunk-CRC32 header, computed like gel/crc/crc32
+ * with an initial value of 0xFFFFFFFF. Chunks are verified before anything reaches the flash, so an upload
+ * interrupted by a bad connection can resume from the offset reported by `GET /firmware_update`; offset 0 always
+ * starts over. A chunked upload with no chunk for 60 seconds is dropped and reported as failed.
+ *  Either way the upload can be gzip compressed, and can be a patch against the running firmware built with
+ * tools/mkdelta.py instead of the whole image.
+ */
 static esp_err_t firmware_update_put_handler(httpd_req_t *req) {
-#define BUFFER_SIZE 1024
+    char query[64];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        return firmware_update_chunk_put(req, query);
+    }
 
-    const esp_partition_t *update_partition = NULL;
-    esp_ota_handle_t       update_handle;
-    esp_err_t              err = ESP_OK;
-    int                    ret;
+    esp_err_t err = ESP_OK;
+    int       ret;
 
-    set_firmware_update_state(FIRMWARE_UPDATE_STATE_UPDATING);
-    vTaskDelay(pdMS_TO_TICKS(1200));     // Allow time for the application to display the update page
+    // The image for the minions is kept in the same partition
+    if (minion_update_running()) {
+        return send_busy(req);
+    } else if ((err = upload_begin(req->content_len)) != ESP_OK) {
+        return upload_fail(req, err);
+    }
 
-    update_partition = esp_ota_get_next_update_partition(NULL);
-    if (update_partition == NULL) {
-        ESP_LOGE(TAG, "esp_ota_get_next_update_partition failed (0x%04X)!", err);
-        httpd_resp_send_500(req);
-        set_firmware_update_state(FIRMWARE_UPDATE_STATE_FAILURE);
+    int64_t start    = esp_timer_get_time();
+    size_t  attempts = 0;
+    while (upload.committed < req->content_len) {
+        // Raw data goes straight into the buffer that is going to be written, while the writer task takes care of
+        // the previous one; compressed data and patches are processed from the upload buffer
+        int      raw    = upload.compressed == 0 && upload.delta == 0;
+        size_t   space  = UPLOAD_BUFFER_SIZE;
+        uint8_t *buffer = raw ? ota_writer_reserve(&space) : upload.buffer;
+        ret             = httpd_req_recv(req, (char *)buffer, space);
+
+        if (ret == 0) {
+            ESP_LOGI(TAG, "Received nothing, continue...");
+            if (attempts++ > 10) {
+                break;
+            }
+        } else if (ret > 0) {
+            attempts = 0;
+
+            err = raw ? upload_commit(ret) : upload_feed(buffer, ret);
+            if (err != ESP_OK) {
+                return upload_fail(req, err);
+            }
+        } else {
+            ESP_LOGW(TAG, "Error while receiving ota: %i", ret);
+            return upload_fail(req, ESP_FAIL);
+        }
+    }
+
+    ESP_LOGI(TAG, "%zu bytes received and written in %i ms", upload.committed,
+             (int)((esp_timer_get_time() - start) / 1000));
+    return upload_finish(req);
+}
+
+
+static esp_err_t firmware_update_chunk_put(httpd_req_t *req, const char *query) {
+    char     value[16];
+    size_t   offset = 0;
+    size_t   size   = 0;
+    uint32_t crc    = 0;
+
+    if (httpd_query_key_value(query, "offset", value, sizeof(value)) == ESP_OK) {
+        offset = strtoul(value, NULL, 10);
+    } else {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, INVALID_CHUNK);
+        return ESP_FAIL;
+    }
+    if (httpd_query_key_value(query, "size", value, sizeof(value)) == ESP_OK) {
+        size = strtoul(value, NULL, 10);
+    } else {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, INVALID_CHUNK);
+        return ESP_FAIL;
+    }
+    if (httpd_req_get_hdr_value_str(req, "X-Chunk-CRC32", value, sizeof(value)) == ESP_OK) {
+        crc = strtoul(value, NULL, 16);
+    } else {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, INVALID_CHUNK);
+        return ESP_FAIL;
+    }
+
+    if (req->content_len == 0 || req->content_len > UPLOAD_BUFFER_SIZE || offset + req->content_len > size) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, INVALID_CHUNK);
         return ESP_FAIL;
     }
 
-    ESP_LOGI(TAG, "Writing to partition subtype %d at offset 0x%x, request size %zu", update_partition->subtype,
-             update_partition->address, req->content_len);
+    if (offset == 0) {
+        if (minion_update_running()) {
+            return send_busy(req);
+        }
 
-    // The following call takes about 1000ms
-    if ((err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &update_handle) != ESP_OK)) {
-        ESP_LOGE(TAG, "esp_ota_begin failed (0x%04X)!", err);
-        httpd_resp_send_500(req);
-        set_firmware_update_state(FIRMWARE_UPDATE_STATE_FAILURE);
+        esp_err_t err = upload_begin(size);
+        if (err != ESP_OK) {
+            return upload_fail(req, err);
+        }
+    } else if (!upload.active || offset != upload.committed || size != upload.size) {
+        // Not the chunk that was expected; the client should resume from the reported offset
+        httpd_resp_set_status(req, "409 Conflict");
+        return send_upload_status(req);
+    }
+
+    size_t received = 0;
+    size_t attempts = 0;
+    while (received < req->content_len) {
+        int ret = httpd_req_recv(req, (char *)&upload.buffer[received], req->content_len - received);
+
+        if (ret == 0) {
+            ESP_LOGI(TAG, "Received nothing, continue...");
+            if (attempts++ > 10) {
+                break;
+            }
+        } else if (ret > 0) {
+            received += ret;
+            attempts = 0;
+        } else {
+            break;
+        }
+    }
+
+    // Even an interrupted chunk keeps the session alive, the client may be about to resume
+    upload.last_chunk = esp_timer_get_time();
+    esp_timer_stop(upload_timer);
+    esp_timer_start_once(upload_timer, UPLOAD_TIMEOUT_US);
+
+    // Nothing was written yet, so the upload is still valid up to the last committed chunk
+    if (received < req->content_len) {
+        ESP_LOGW(TAG, "Chunk at %zu interrupted after %zu bytes", offset, received);
+        return ESP_FAIL;
+    } else if (crc32(upload.buffer, received, CHUNK_CRC_INIT) != crc) {
+        ESP_LOGW(TAG, "Chunk at %zu corrupted", offset);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, CHUNK_CRC_ERR);
         return ESP_FAIL;
     }
 
-    char *buffer = malloc(BUFFER_SIZE);
+    esp_err_t err = upload_feed(upload.buffer, received);
+    if (err != ESP_OK) {
+        return upload_fail(req, err);
+    }
+
+    if (upload.committed == upload.size) {
+        return upload_finish(req);
+    } else {
+        return send_upload_status(req);
+    }
+}
+
+
+static esp_err_t firmware_update_get_handler(httpd_req_t *req) {
+    return send_upload_status(req);
+}
+
+
+/*
+ *  `PUT /minion_firmware?devices=M` stores an image for the minion boards, which are then updated over RS485 one
+ * after the other (M is the mask of devices, bit 0 for address 1). The request is answered as soon as the image is
+ * stored; the outcome for each device is shown on the display.
+ */
+static esp_err_t minion_firmware_put_handler(httpd_req_t *req) {
+    char    query[32];
+    char    value[8];
+    uint8_t device_mask = 0;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "devices", value, sizeof(value)) == ESP_OK) {
+        device_mask = strtoul(value, NULL, 0);
+    }
+
+    if (device_mask == 0 || req->content_len == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, INVALID_REQUEST);
+        return ESP_FAIL;
+    } else if (upload.active || minion_update_running()) {
+        return send_busy(req);
+    } else if (minion_image_begin(req->content_len)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, INVALID_REQUEST);
+        return ESP_FAIL;
+    }
+
+    uint8_t *buffer = malloc(UPLOAD_BUFFER_SIZE);
     if (buffer == NULL) {
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, MEMORY_ERR_STRING);
-        set_firmware_update_state(FIRMWARE_UPDATE_STATE_FAILURE);
         return ESP_FAIL;
     }
 
-    size_t total    = 0;
-    size_t attempts = 0;
+    uint32_t crc      = CHUNK_CRC_INIT;
+    size_t   total    = 0;
+    size_t   attempts = 0;
     while (total < req->content_len) {
-        ret = httpd_req_recv(req, buffer, BUFFER_SIZE);
+        int ret = httpd_req_recv(req, (char *)buffer, UPLOAD_BUFFER_SIZE);
 
         if (ret == 0) {
             ESP_LOGI(TAG, "Received nothing, continue...");
@@ -150,41 +480,195 @@ static esp_err_t firmware_update_put_handler(httpd_req_t *req) {
                 break;
             }
         } else if (ret > 0) {
-            ESP_LOGI(TAG, "Reading %i bytes into flash...", ret);
-            total += ret;
             attempts = 0;
+            total += ret;
+            crc = crc32(buffer, ret, crc);
 
-            if ((err = esp_ota_write(update_handle, buffer, ret)) != ESP_OK) {
-                ESP_LOGE(TAG, "esp_ota_write failed (0x%04X)!", err);
-                free(buffer);
-                esp_ota_abort(update_handle);
-                httpd_resp_send_500(req);
-                set_firmware_update_state(FIRMWARE_UPDATE_STATE_FAILURE);
-                return ESP_FAIL;
-            } else {
-                vTaskDelay(1);     // Delay for WDT
+            if (minion_image_write(buffer, ret)) {
+                ESP_LOGE(TAG, "Could not store the minion image!");
+                break;
             }
         } else {
-            ESP_LOGW(TAG, "Error while receiving ota: %i", ret);
-            free(buffer);
-            esp_ota_abort(update_handle);
-            httpd_resp_send_500(req);
-            set_firmware_update_state(FIRMWARE_UPDATE_STATE_FAILURE);
-            return ESP_FAIL;
+            ESP_LOGW(TAG, "Error while receiving minion image: %i", ret);
+            break;
         }
     }
     free(buffer);
 
-    if ((err = esp_ota_end(update_handle)) != ESP_OK) {
+    if (total < req->content_len) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Minion image of %zu bytes (crc 0x%08X) for 0x%02X", total, (unsigned)crc, device_mask);
+    xSemaphoreTake(sem, portMAX_DELAY);
+    minion_update.pending     = 1;
+    minion_update.running     = 1;
+    minion_update.size        = total;
+    minion_update.crc         = crc;
+    minion_update.device_mask = device_mask;
+    xSemaphoreGive(sem);
+    wakeup_notify();
+
+    httpd_resp_set_status(req, "202 Accepted");
+    httpd_resp_send(req, "", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+
+static esp_err_t send_busy(httpd_req_t *req) {
+    httpd_resp_set_status(req, "409 Conflict");
+    httpd_resp_send(req, BUSY_ERR_STRING, HTTPD_RESP_USE_STRLEN);
+    return ESP_FAIL;
+}
+
+
+static uint8_t minion_update_running(void) {
+    xSemaphoreTake(sem, portMAX_DELAY);
+    uint8_t res = minion_update.running;
+    xSemaphoreGive(sem);
+    return res;
+}
+
+
+static esp_err_t send_upload_status(httpd_req_t *req) {
+    char string[64];
+    snprintf(string, sizeof(string), "{\"offset\":%zu,\"size\":%zu}", upload.committed, upload.size);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, string, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+
+static size_t upload_heap_size(void) {
+    return UPLOAD_BUFFER_SIZE + ota_writer_heap_size() + ota_inflate_heap_size() + ota_delta_heap_size();
+}
+
+
+/*
+ *  Starts a new upload, dropping the current one if any
+ */
+static esp_err_t upload_begin(size_t size) {
+    upload_abort();
+
+    set_firmware_update_state(FIRMWARE_UPDATE_STATE_UPDATING);
+    vTaskDelay(pdMS_TO_TICKS(1200));     // Allow time for the application to display the update page
+
+    upload.partition = esp_ota_get_next_update_partition(NULL);
+    if (upload.partition == NULL) {
+        ESP_LOGE(TAG, "esp_ota_get_next_update_partition failed!");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Writing to partition subtype %d at offset 0x%x, upload size %zu", upload.partition->subtype,
+             upload.partition->address, size);
+
+    if ((upload.buffer = malloc(UPLOAD_BUFFER_SIZE)) == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = ota_writer_begin(upload.partition);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "ota_writer_begin failed (0x%04X)!", err);
+        free(upload.buffer);
+        upload.buffer = NULL;
+        return err;
+    }
+
+    upload.active     = 1;
+    upload.compressed = -1;
+    upload.delta      = -1;
+    upload.committed  = 0;
+    upload.size       = size;
+    return ESP_OK;
+}
+
+
+/*
+ *  Passes on the next part of the upload; the first bytes tell whether it is compressed or not
+ */
+static esp_err_t upload_feed(const uint8_t *data, size_t len) {
+    esp_err_t err = ESP_OK;
+
+    if (upload.compressed < 0) {
+        upload.compressed = ota_inflate_is_compressed(data, len);
+        if (upload.compressed) {
+            ESP_LOGI(TAG, "Compressed image");
+            if ((err = ota_inflate_begin(upload_output)) != ESP_OK) {
+                return err;
+            }
+        }
+    }
+
+    err = upload.compressed ? ota_inflate_feed(data, len) : upload_output(data, len);
+    if (err == ESP_OK) {
+        upload.committed += len;
+    }
+    return err;
+}
+
+
+/*
+ *  Takes the upload once decompressed, which is either the new image or a patch against the running one
+ */
+static esp_err_t upload_output(const uint8_t *data, size_t len) {
+    if (upload.delta < 0) {
+        upload.delta = ota_delta_is_delta(data, len);
+        if (upload.delta) {
+            ESP_LOGI(TAG, "Delta image");
+            esp_err_t err = ota_delta_begin();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    }
+
+    return upload.delta ? ota_delta_feed(data, len) : ota_writer_write(data, len);
+}
+
+
+/*
+ *  Confirms raw data placed with ota_writer_reserve
+ */
+static esp_err_t upload_commit(size_t len) {
+    esp_err_t err = ota_writer_commit(len);
+    if (err == ESP_OK) {
+        upload.committed += len;
+    }
+    return err;
+}
+
+
+static esp_err_t upload_finish(httpd_req_t *req) {
+    esp_err_t err = ESP_OK;
+
+    if (upload.compressed > 0) {
+        upload.compressed = 0;
+        if ((err = ota_inflate_end()) != ESP_OK) {
+            return upload_fail(req, err);
+        }
+    }
+    if (upload.delta > 0) {
+        upload.delta = 0;
+        if ((err = ota_delta_end()) != ESP_OK) {
+            return upload_fail(req, err);
+        }
+    }
+
+    const esp_partition_t *partition = upload.partition;
+    free(upload.buffer);
+    upload = (upload_t){0};
+
+    if ((err = ota_writer_end()) != ESP_OK) {
         // Invalid image
         ESP_LOGW(TAG, "Invalid OTA image (0x%X)", err);
-        esp_ota_abort(update_handle);
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, INVALID_OTA);
         set_firmware_update_state(FIRMWARE_UPDATE_STATE_FAILURE);
         return ESP_FAIL;
     }
 
-    if ((err = esp_ota_set_boot_partition(update_partition) != ESP_OK)) {
+    if ((err = esp_ota_set_boot_partition(partition)) != ESP_OK) {
         ESP_LOGE(TAG, "esp_ota_set_boot_partition failed (0x%04X)!", err);
         httpd_resp_send_500(req);
         set_firmware_update_state(FIRMWARE_UPDATE_STATE_FAILURE);
@@ -199,8 +683,66 @@ static esp_err_t firmware_update_put_handler(httpd_req_t *req) {
 }
 
 
+static esp_err_t upload_fail(httpd_req_t *req, esp_err_t err) {
+    upload_abort();
+
+    if (err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, INVALID_OTA);
+    } else if (err == ESP_ERR_NO_MEM) {
+        // Measured after the abort, so this is what the next attempt would have
+        ESP_LOGE(TAG, "An update needs up to %zu bytes of heap, %zu free (largest block %zu)", upload_heap_size(),
+                 heap_caps_get_free_size(MALLOC_CAP_8BIT), heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, OTA_MEMORY_ERR);
+    } else {
+        ESP_LOGE(TAG, "Firmware update failed (0x%04X)!", err);
+        httpd_resp_send_500(req);
+    }
+
+    set_firmware_update_state(FIRMWARE_UPDATE_STATE_FAILURE);
+    return ESP_FAIL;
+}
+
+
+static void upload_abort(void) {
+    if (upload.active) {
+        if (upload.compressed > 0) {
+            ota_inflate_end();
+        }
+        if (upload.delta > 0) {
+            ota_delta_end();
+        }
+        ota_writer_abort();
+        free(upload.buffer);
+        upload = (upload_t){0};
+    }
+}
+
+
+/*
+ *  Runs in the timer task, while the upload belongs to the server task
+ */
+static void upload_timer_callback(void *args) {
+    (void)args;
+    if (server != NULL) {
+        httpd_queue_work(server, upload_expire, NULL);
+    }
+}
+
+
+static void upload_expire(void *args) {
+    (void)args;
+    // A chunk may have come in or the upload may have ended after the timer fired
+    if (upload.active && esp_timer_get_time() - upload.last_chunk >= UPLOAD_TIMEOUT_US) {
+        ESP_LOGW(TAG, "Upload abandoned at %zu of %zu bytes", upload.committed, upload.size);
+        upload_abort();
+        set_firmware_update_state(FIRMWARE_UPDATE_STATE_FAILURE);
+    }
+}
+
+
 static void set_firmware_update_state(firmware_update_state_t state) {
     xSemaphoreTake(sem, portMAX_DELAY);
     firmware_update = state;
     xSemaphoreGive(sem);
+    wakeup_notify();
 }
\ No newline at end of file
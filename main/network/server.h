@@ -9,6 +9,8 @@ void                    server_init(void);
 void                    server_stop(void);
 void                    server_start(void);
 firmware_update_state_t server_firmware_update_state(void);
+uint8_t                 server_take_minion_update(size_t *size, uint32_t *crc, uint8_t *device_mask);
+void                    server_minion_update_done(void);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <esp_spi_flash.h>
+#include <esp_log.h>
+#include "minion_image.h"
+
+
+/*
+ *  Firmware images for the minion boards are kept in the OTA partition the master is not running from, which is
+ * otherwise unused between updates of the master itself.
+ */
+
+
+static const char *TAG = "MinionImage";
+
+static const esp_partition_t *partition = NULL;
+static size_t                 written   = 0;
+static size_t                 erased    = 0;
+
+
+/*
+ *  Prepares to store an image of `size` bytes; fails if it does not fit or if the partition holds an update of the
+ * master waiting for a reset
+ */
+int minion_image_begin(size_t size) {
+    partition = esp_ota_get_next_update_partition(NULL);
+
+    if (partition == NULL || size > partition->size) {
+        ESP_LOGW(TAG, "No room for a %zu bytes image", size);
+        partition = NULL;
+        return -1;
+    } else if (partition == esp_ota_get_boot_partition()) {
+        ESP_LOGW(TAG, "An update is waiting for a reset");
+        partition = NULL;
+        return -1;
+    }
+
+    written = 0;
+    erased  = 0;
+    return 0;
+}
+
+
+/*
+ *  Appends to the image, erasing one sector at a time right before it is needed
+ */
+int minion_image_write(const uint8_t *data, size_t len) {
+    if (partition == NULL || written + len > partition->size) {
+        return -1;
+    }
+
+    while (erased < written + len) {
+        if (esp_partition_erase_range(partition, erased, SPI_FLASH_SEC_SIZE) != ESP_OK) {
+            return -1;
+        }
+        erased += SPI_FLASH_SEC_SIZE;
+    }
+
+    if (esp_partition_write(partition, written, data, len) != ESP_OK) {
+        return -1;
+    }
+
+    written += len;
+    return 0;
+}
+
+
+int minion_image_read(size_t offset, void *data, size_t len) {
+    if (partition == NULL || offset + len > written) {
+        return -1;
+    }
+
+    return esp_partition_read(partition, offset, data, len) != ESP_OK;
+}
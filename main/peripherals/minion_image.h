@@ -0,0 +1,14 @@
+#ifndef MINION_IMAGE_H_INCLUDED
+#define MINION_IMAGE_H_INCLUDED
+
+
+#include <stdint.h>
+#include <stdlib.h>
+
+
+int minion_image_begin(size_t size);
+int minion_image_write(const uint8_t *data, size_t len);
+int minion_image_read(size_t offset, void *data, size_t len);
+
+
+#endif
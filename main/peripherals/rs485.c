@@ -5,16 +5,24 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include <string.h>
 #include "config/app_config.h"
 
 
-#define PORTNUM        UART_NUM_1
-#define ECHO_READ_TOUT (3)     // 3.5T * 8 = 28 ticks, TOUT=3 -> ~24..33 ticks
+#define PORTNUM          UART_NUM_1
+#define ECHO_READ_TOUT   (3)     // 3.5T * 8 = 28 ticks, TOUT=3 -> ~24..33 ticks
+#define EVENT_QUEUE_SIZE 16
+
+
+static uint32_t frame_silence_us(uint32_t baud_rate);
+static void     wait_frame_silence(void);
 
 
 static const char   *TAG              = "RS485";
 static QueueHandle_t uart_event_queue = NULL;
+static int64_t       last_activity    = 0;
+static uint32_t      baud_rate        = APP_CONFIG_DEFAULT_BAUD_RATE;
 
 
 void rs485_init(void) {
@@ -31,7 +39,7 @@ void rs485_init(void) {
     gpio_set_level(HAP_DIR, 0);
 
     uart_config_t uart_config = {
-        .baud_rate           = 19200,
+        .baud_rate           = baud_rate,
         .data_bits           = UART_DATA_8_BITS,
         .parity              = UART_PARITY_DISABLE,
         .stop_bits           = UART_STOP_BITS_1,
@@ -43,7 +51,7 @@ void rs485_init(void) {
     ESP_ERROR_CHECK(uart_param_config(PORTNUM, &uart_config));
 
     uart_set_pin(PORTNUM, HAP_TX_485, HAP_RX_485, -1, -1);
-    ESP_ERROR_CHECK(uart_driver_install(PORTNUM, 512, 512, 16, &uart_event_queue, 0));
+    ESP_ERROR_CHECK(uart_driver_install(PORTNUM, 512, 512, EVENT_QUEUE_SIZE, &uart_event_queue, 0));
     ESP_ERROR_CHECK(uart_set_mode(PORTNUM, UART_MODE_RS485_HALF_DUPLEX));
     ESP_ERROR_CHECK(uart_set_rx_timeout(PORTNUM, ECHO_READ_TOUT));
 }
@@ -54,6 +62,18 @@ void rs485_wait_tx_done(void) {
 }
 
 
+void rs485_set_baud_rate(uint32_t rate) {
+    if (rate != baud_rate) {
+        ESP_LOGI(TAG, "Switching to %u baud", (unsigned)rate);
+        ESP_ERROR_CHECK(uart_wait_tx_done(PORTNUM, portMAX_DELAY));
+        ESP_ERROR_CHECK(uart_set_baudrate(PORTNUM, rate));
+        baud_rate = rate;
+        rs485_flush();
+        xQueueReset(uart_event_queue);
+    }
+}
+
+
 void rs485_flush(void) {
     uart_flush(PORTNUM);
 }
@@ -65,18 +85,112 @@ void rs485_flush_input(void) {
 
 
 void rs485_write(uint8_t *buffer, size_t len) {
+    wait_frame_silence();
     gpio_set_level(HAP_DIR, 1);
     ets_delay_us(10);
     uart_write_bytes(PORTNUM, buffer, len);
     ESP_ERROR_CHECK(uart_wait_tx_done(PORTNUM, portMAX_DELAY));
     gpio_set_level(HAP_DIR, 0);
+    last_activity = esp_timer_get_time();
     ets_delay_us(10);
     // In this particular project asserting/deasserting the DIR line causes a couple of null bytes to be received, so we
     // must flush them
     rs485_flush();
+    // Along with the events they generated, so that the next frame starts from a clean slate
+    xQueueReset(uart_event_queue);
 }
 
 
 int rs485_read(uint8_t *buffer, size_t len, unsigned long timeout_ms) {
-    return uart_read_bytes(PORTNUM, buffer, len, pdMS_TO_TICKS(timeout_ms));
+    int res = uart_read_bytes(PORTNUM, buffer, len, pdMS_TO_TICKS(timeout_ms));
+    if (res > 0) {
+        last_activity = esp_timer_get_time();
+    }
+    return res;
+}
+
+
+/*
+ *  Receives a single frame. The driver signals an RX timeout as soon as the line has been idle for ECHO_READ_TOUT
+ *  character times, so the frame is returned as soon as it is over instead of waiting for `timeout_ms` to expire.
+ *  Leading null bytes caused by the direction switch are discarded. Returns the length of the frame, 0 if no whole
+ *  frame came in within `timeout_ms` (however many events arrived meanwhile) or -1 on overflow
+ */
+int rs485_receive_frame(uint8_t *buffer, size_t len, unsigned long timeout_ms) {
+    uart_event_t event    = {0};
+    size_t       received = 0;
+    TickType_t   start    = xTaskGetTickCount();
+    TickType_t   timeout  = pdMS_TO_TICKS(timeout_ms);
+    TickType_t   elapsed  = 0;
+
+    while (elapsed < timeout && xQueueReceive(uart_event_queue, &event, timeout - elapsed)) {
+        elapsed = xTaskGetTickCount() - start;
+
+        switch (event.type) {
+            case UART_DATA: {
+                size_t available = 0;
+                uart_get_buffered_data_len(PORTNUM, &available);
+                if (available > len - received) {
+                    available = len - received;
+                }
+
+                int res = uart_read_bytes(PORTNUM, &buffer[received], available, 0);
+                if (res > 0) {
+                    last_activity = esp_timer_get_time();
+
+                    if (received == 0) {
+                        size_t skip = 0;
+                        while (skip < (size_t)res && buffer[skip] == 0) {
+                            skip++;
+                        }
+                        memmove(buffer, &buffer[skip], res - skip);
+                        res -= skip;
+                    }
+                    received += res;
+                }
+
+                // Either the bus went idle (end of frame) or there is no more room
+                if (received > 0 && (event.timeout_flag || received == len)) {
+                    return received;
+                }
+                break;
+            }
+
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                ESP_LOGW(TAG, "RX overflow");
+                uart_flush_input(PORTNUM);
+                xQueueReset(uart_event_queue);
+                return -1;
+
+            default:
+                break;
+        }
+    }
+
+    // The frame was not over in time; whatever came in is incomplete
+    return 0;
+}
+
+
+/*
+ *  Modbus RTU frames must be separated by at least 3.5 character times (11 bits each); above 19200 baud the
+ *  specification fixes the interval at 1750us
+ */
+static uint32_t frame_silence_us(uint32_t baud_rate) {
+    if (baud_rate > 19200) {
+        return 1750;
+    } else {
+        return (35UL * 11UL * 100000UL) / baud_rate;
+    }
+}
+
+
+static void wait_frame_silence(void) {
+    int64_t  elapsed = esp_timer_get_time() - last_activity;
+    uint32_t silence = frame_silence_us(baud_rate);
+
+    if (elapsed >= 0 && elapsed < silence) {
+        ets_delay_us(silence - elapsed);
+    }
 }
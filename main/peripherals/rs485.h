@@ -9,9 +9,11 @@
 void rs485_init(void);
 void rs485_write(uint8_t *buffer, size_t len);
 int  rs485_read(uint8_t *buffer, size_t len, unsigned long timeout_ms);
+int  rs485_receive_frame(uint8_t *buffer, size_t len, unsigned long timeout_ms);
 void rs485_flush(void);
 void rs485_flush_input(void);
 void rs485_wait_tx_done(void);
+void rs485_set_baud_rate(uint32_t baud_rate);
 
 
 #endif
@@ -10,8 +10,23 @@
 #define COMPATIBILITY_VERSION 1
 
 
+static esp_err_t open_handle(nvs_open_mode_t mode, nvs_handle_t *handle);
+static void      close_handle(nvs_handle_t handle, uint8_t written);
+
+
 static const char *TAG = "Storage";
 
+/*
+ *  While a session is active every load and save goes through the same handle, opened on first use; writes are
+ *  staged and committed together when the session is closed
+ */
+static struct {
+    uint8_t      active;
+    uint8_t      opened;
+    uint8_t      dirty;
+    nvs_handle_t handle;
+} session = {0};
+
 
 void storage_init(void) {
     // Initialize NVS
@@ -49,14 +64,39 @@ void storage_init(void) {
 }
 
 
+void storage_session_open(void) {
+    assert(!session.active);
+    session.active = 1;
+    session.opened = 0;
+    session.dirty  = 0;
+}
+
+
+void storage_session_close(void) {
+    assert(session.active);
+
+    if (session.opened) {
+        if (session.dirty) {
+            ESP_LOGI(TAG, "Committing staged changes");
+            ESP_ERROR_CHECK(nvs_commit(session.handle));
+        }
+        nvs_close(session.handle);
+    }
+
+    session.active = 0;
+    session.opened = 0;
+    session.dirty  = 0;
+}
+
+
 int storage_load_uint8(uint8_t *value, char *key) {
     nvs_handle_t handle;
     esp_err_t    err;
     assert(strlen(key) <= 15);
 
-    ESP_ERROR_CHECK(nvs_open("storage", NVS_READONLY, &handle));
+    ESP_ERROR_CHECK(open_handle(NVS_READONLY, &handle));
     err = nvs_get_u8(handle, key, value);
-    nvs_close(handle);
+    close_handle(handle, 0);
     if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
         ESP_LOGE(TAG, "NVS error (%s) while reading %s", esp_err_to_name(err), key);
         return -1;
@@ -68,9 +108,10 @@ int storage_load_uint8(uint8_t *value, char *key) {
 
 void storage_save_uint8(uint8_t *value, char *key) {
     nvs_handle_t handle;
+    ESP_LOGI(TAG, "Trying to save key %s", key);
     assert(strlen(key) <= 15);
 
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &handle);
+    esp_err_t err = open_handle(NVS_READWRITE, &handle);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error (%i) opening NVS handle!\n", err);
         return;
@@ -79,10 +120,8 @@ void storage_save_uint8(uint8_t *value, char *key) {
     err = nvs_set_u8(handle, key, *value);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "NVS error (%i) while writing %s", err, key);
-    } else {
-        ESP_ERROR_CHECK(nvs_commit(handle));
-        nvs_close(handle);
     }
+    close_handle(handle, err == ESP_OK);
 }
 
 
@@ -91,9 +130,9 @@ int storage_load_uint16(uint16_t *value, char *key) {
     esp_err_t    err;
     assert(strlen(key) <= 15);
 
-    ESP_ERROR_CHECK(nvs_open("storage", NVS_READONLY, &handle));
+    ESP_ERROR_CHECK(open_handle(NVS_READONLY, &handle));
     err = nvs_get_u16(handle, key, value);
-    nvs_close(handle);
+    close_handle(handle, 0);
     if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
         ESP_LOGE(TAG, "NVS error (%s) while reading %s", esp_err_to_name(err), key);
         return -1;
@@ -108,7 +147,7 @@ void storage_save_uint16(uint16_t *value, char *key) {
     ESP_LOGI(TAG, "Trying to save key %s", key);
     assert(strlen(key) <= 15);
 
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &handle);
+    esp_err_t err = open_handle(NVS_READWRITE, &handle);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error (%i) opening NVS handle!\n", err);
         return;
@@ -117,10 +156,8 @@ void storage_save_uint16(uint16_t *value, char *key) {
     err = nvs_set_u16(handle, key, *value);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "NVS error (%i) while writing %s", err, key);
-    } else {
-        ESP_ERROR_CHECK(nvs_commit(handle));
-        nvs_close(handle);
     }
+    close_handle(handle, err == ESP_OK);
 }
 
 
@@ -129,9 +166,9 @@ int storage_load_uint32(uint32_t *value, char *key) {
     esp_err_t    err;
     assert(strlen(key) <= 15);
 
-    ESP_ERROR_CHECK(nvs_open("storage", NVS_READONLY, &handle));
+    ESP_ERROR_CHECK(open_handle(NVS_READONLY, &handle));
     err = nvs_get_u32(handle, key, value);
-    nvs_close(handle);
+    close_handle(handle, 0);
     if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
         ESP_LOGE(TAG, "NVS error (%s) while reading %s", esp_err_to_name(err), key);
         return -1;
@@ -146,7 +183,7 @@ void storage_save_uint32(uint32_t *value, char *key) {
     ESP_LOGI(TAG, "Trying to save key %s", key);
     assert(strlen(key) <= 15);
 
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &handle);
+    esp_err_t err = open_handle(NVS_READWRITE, &handle);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error (%i) opening NVS handle!\n", err);
         return;
@@ -155,10 +192,8 @@ void storage_save_uint32(uint32_t *value, char *key) {
     err = nvs_set_u32(handle, key, *value);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "NVS error (%i) while writing %s", err, key);
-    } else {
-        ESP_ERROR_CHECK(nvs_commit(handle));
-        nvs_close(handle);
     }
+    close_handle(handle, err == ESP_OK);
 }
 
 
@@ -167,9 +202,9 @@ int storage_load_uint64(uint64_t *value, char *key) {
     esp_err_t    err;
     assert(strlen(key) <= 15);
 
-    ESP_ERROR_CHECK(nvs_open("storage", NVS_READONLY, &handle));
+    ESP_ERROR_CHECK(open_handle(NVS_READONLY, &handle));
     err = nvs_get_u64(handle, key, value);
-    nvs_close(handle);
+    close_handle(handle, 0);
     if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
         ESP_LOGE(TAG, "NVS error (%s) while reading %s", esp_err_to_name(err), key);
         return -1;
@@ -184,7 +219,7 @@ void storage_save_uint64(uint64_t *value, char *key) {
     ESP_LOGI(TAG, "Trying to save key %s", key);
     assert(strlen(key) <= 15);
 
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &handle);
+    esp_err_t err = open_handle(NVS_READWRITE, &handle);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error (%i) opening NVS handle!\n", err);
         return;
@@ -193,10 +228,8 @@ void storage_save_uint64(uint64_t *value, char *key) {
     err = nvs_set_u64(handle, key, *value);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "NVS error (%i) while writing %s", err, key);
-    } else {
-        ESP_ERROR_CHECK(nvs_commit(handle));
-        nvs_close(handle);
     }
+    close_handle(handle, err == ESP_OK);
 }
 
 
@@ -205,9 +238,9 @@ int storage_load_blob(void *value, size_t len, char *key) {
     esp_err_t    err;
     assert(strlen(key) <= 15);
 
-    ESP_ERROR_CHECK(nvs_open("storage", NVS_READONLY, &handle));
+    ESP_ERROR_CHECK(open_handle(NVS_READONLY, &handle));
     err = nvs_get_blob(handle, key, value, &len);
-    nvs_close(handle);
+    close_handle(handle, 0);
     if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
         ESP_LOGE(TAG, "NVS error (%s) while reading %s", esp_err_to_name(err), key);
         return -1;
@@ -222,7 +255,7 @@ void storage_save_blob(void *value, size_t len, char *key) {
     ESP_LOGI(TAG, "Trying to save key %s", key);
     assert(strlen(key) <= 15);
 
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &handle);
+    esp_err_t err = open_handle(NVS_READWRITE, &handle);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error (%i) opening NVS handle!\n", err);
         return;
@@ -231,8 +264,38 @@ void storage_save_blob(void *value, size_t len, char *key) {
     err = nvs_set_blob(handle, key, value, len);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "NVS error (%i) while writing %s", err, key);
-    } else {
+    }
+    close_handle(handle, err == ESP_OK);
+}
+
+
+static esp_err_t open_handle(nvs_open_mode_t mode, nvs_handle_t *handle) {
+    if (!session.active) {
+        return nvs_open("storage", mode, handle);
+    }
+
+    if (!session.opened) {
+        // Sessions may write, so the handle is always opened read-write
+        esp_err_t err = nvs_open("storage", NVS_READWRITE, &session.handle);
+        if (err != ESP_OK) {
+            return err;
+        }
+        session.opened = 1;
+    }
+
+    *handle = session.handle;
+    return ESP_OK;
+}
+
+
+static void close_handle(nvs_handle_t handle, uint8_t written) {
+    if (session.active) {
+        session.dirty |= written;
+        return;
+    }
+
+    if (written) {
         ESP_ERROR_CHECK(nvs_commit(handle));
-        nvs_close(handle);
     }
+    nvs_close(handle);
 }
@@ -5,6 +5,8 @@
 #include <stdlib.h>
 
 void storage_init(void);
+void storage_session_open(void);
+void storage_session_close(void);
 
 int  storage_load_uint8(uint8_t *value, char *key);
 void storage_save_uint8(uint8_t *value, char *key);
@@ -0,0 +1,29 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "wakeup.h"
+
+
+/*
+ *  The main loop sleeps on its own task notification; whoever produces something for it to handle (Modbus
+ *  responses, server state changes, view events) sends one
+ */
+
+
+static TaskHandle_t main_task = NULL;
+
+
+void wakeup_init(void) {
+    main_task = xTaskGetCurrentTaskHandle();
+}
+
+
+void wakeup_notify(void) {
+    if (main_task != NULL) {
+        xTaskNotifyGive(main_task);
+    }
+}
+
+
+void wakeup_wait(uint32_t timeout_ms) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+}
@@ -0,0 +1,13 @@
+#ifndef WAKEUP_H_INCLUDED
+#define WAKEUP_H_INCLUDED
+
+
+#include <stdint.h>
+
+
+void wakeup_init(void);
+void wakeup_notify(void);
+void wakeup_wait(uint32_t timeout_ms);
+
+
+#endif
@@ -0,0 +1,92 @@
+#include "lvgl.h"
+#include "fan_frames.h"
+#include "esp_log.h"
+
+
+/*
+ *  The fan icon has three blades, so a third of a turn is enough to loop the rotation seamlessly
+ */
+#define SYMMETRY_ANGLE 1200
+#define NUM_FRAMES     12
+#define FRAME_WIDTH    58
+#define FRAME_HEIGHT   56
+
+
+LV_IMG_DECLARE(img_ventola);
+
+
+static int build_frames(void);
+
+
+static const char  *TAG = "FanFrames";
+static lv_img_dsc_t frames[NUM_FRAMES];
+static uint8_t     *frames_data = NULL;
+static int          frames_state = 0; // 0 not built yet, 1 built, -1 could not be built
+
+
+/*
+ *  Animation callback with the same semantic of lv_img_set_angle (tenths of degree). Instead of rotating the image on
+ * every refresh it swaps in one of NUM_FRAMES pre-rotated copies, which are drawn with no transformation at all.
+ * The frames only keep the alpha channel (the icon is a single color) and take the color from the img_recolor style,
+ * black by default like the original icon.
+ */
+void fan_frames_set_angle(void *img, int32_t angle) {
+    if (frames_state == 0) {
+        frames_state = build_frames() ? -1 : 1;
+    }
+
+    if (frames_state < 0) {
+        lv_img_set_angle(img, angle);
+        return;
+    }
+
+    const lv_img_dsc_t *frame = &frames[((angle % SYMMETRY_ANGLE) * NUM_FRAMES) / SYMMETRY_ANGLE];
+    if (lv_img_get_src(img) != frame) {
+        lv_img_set_src(img, frame);
+    }
+}
+
+
+/*
+ *  Rotates the icon once per frame at the first use; the frames are then kept for the whole lifetime of the application
+ */
+static int build_frames(void) {
+    LV_ASSERT(img_ventola.header.w == FRAME_WIDTH && img_ventola.header.h == FRAME_HEIGHT);
+
+    frames_data = lv_mem_alloc(NUM_FRAMES * FRAME_WIDTH * FRAME_HEIGHT);
+    if (frames_data == NULL) {
+        ESP_LOGW(TAG, "Not enough memory for the fan frames, falling back to live rotation");
+        return -1;
+    }
+
+    lv_draw_img_dsc_t draw_dsc;
+    lv_draw_img_dsc_init(&draw_dsc);
+    draw_dsc.pivot.x   = FRAME_WIDTH / 2;
+    draw_dsc.pivot.y   = FRAME_HEIGHT / 2;
+    draw_dsc.antialias = 1;
+
+    lv_draw_ctx_t *draw_ctx = lv_disp_get_default()->driver->draw_ctx;
+    lv_color_t     cbuf[FRAME_WIDTH];
+
+    for (size_t i = 0; i < NUM_FRAMES; i++) {
+        uint8_t *data  = &frames_data[i * FRAME_WIDTH * FRAME_HEIGHT];
+        draw_dsc.angle = (i * SYMMETRY_ANGLE) / NUM_FRAMES;
+
+        for (lv_coord_t y = 0; y < FRAME_HEIGHT; y++) {
+            lv_area_t row = {.x1 = 0, .x2 = FRAME_WIDTH - 1, .y1 = y, .y2 = y};
+            lv_draw_transform(draw_ctx, &row, img_ventola.data, FRAME_WIDTH, FRAME_HEIGHT, FRAME_WIDTH, &draw_dsc,
+                              img_ventola.header.cf, cbuf, &data[y * FRAME_WIDTH]);
+        }
+
+        frames[i] = (lv_img_dsc_t){
+            .header.cf = LV_IMG_CF_ALPHA_8BIT,
+            .header.w  = FRAME_WIDTH,
+            .header.h  = FRAME_HEIGHT,
+            .data_size = FRAME_WIDTH * FRAME_HEIGHT,
+            .data      = data,
+        };
+    }
+
+    ESP_LOGI(TAG, "Built %i fan frames", NUM_FRAMES);
+    return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef FAN_FRAMES_H_INCLUDED
+#define FAN_FRAMES_H_INCLUDED
+
+
+#include <stdint.h>
+
+
+void fan_frames_set_angle(void *img, int32_t angle);
+
+
+#endif
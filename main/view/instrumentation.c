@@ -0,0 +1,127 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "lvgl.h"
+#include "gel/timer/timecheck.h"
+#include "utils/utils.h"
+#include "instrumentation.h"
+#include "esp_log.h"
+#ifndef SIMULATOR
+#include "esp_heap_caps.h"
+#endif
+
+
+#define INSTRUMENTATION_WINDOW  1000UL
+#define INSTRUMENTATION_SAMPLES 32
+#define SLOW_HANDLER_US         50000UL
+
+
+static void     close_window(unsigned long timestamp);
+static uint32_t memory_high_water(void);
+
+
+static const char *TAG = "Instrumentation";
+
+static SemaphoreHandle_t sem = NULL;
+
+// Samples are only written by the LVGL task, but may be read from elsewhere (i.e. the HTTP server)
+static instrumentation_sample_t samples[INSTRUMENTATION_SAMPLES] = {0};
+static size_t                   first                            = 0;
+static size_t                   count                            = 0;
+
+static instrumentation_sample_t current      = {0};
+static unsigned long            window_start = 0;
+
+
+void instrumentation_init(void) {
+    static StaticSemaphore_t mutex_buffer;
+    sem = xSemaphoreCreateMutexStatic(&mutex_buffer);
+
+    window_start    = get_millis();
+    current.page_id = -1;
+}
+
+
+void instrumentation_record_handler(int page_id, uint32_t elapsed_us) {
+    unsigned long now = get_millis();
+
+    if (page_id != current.page_id || is_expired(window_start, now, INSTRUMENTATION_WINDOW)) {
+        close_window(now);
+        current.page_id = page_id;
+    }
+
+    current.handler_calls++;
+    current.handler_total_us += elapsed_us;
+    if (elapsed_us > current.handler_max_us) {
+        current.handler_max_us = elapsed_us;
+    }
+}
+
+
+/*
+ *  Invoked through the display driver's monitor callback once a whole refresh has been flushed
+ */
+void instrumentation_record_refresh(uint32_t time_ms, uint32_t pixels) {
+    current.frames++;
+    current.flush_bytes += pixels * sizeof(lv_color_t);
+    if (time_ms > current.refresh_max_ms) {
+        current.refresh_max_ms = time_ms;
+    }
+}
+
+
+/*
+ *  Copies up to `max` of the most recent samples, oldest first, and returns how many were copied
+ */
+size_t instrumentation_get_samples(instrumentation_sample_t *buffer, size_t max) {
+    xSemaphoreTake(sem, portMAX_DELAY);
+    size_t num = count < max ? count : max;
+    for (size_t i = 0; i < num; i++) {
+        buffer[i] = samples[(first + count - num + i) % INSTRUMENTATION_SAMPLES];
+    }
+    xSemaphoreGive(sem);
+    return num;
+}
+
+
+static void close_window(unsigned long timestamp) {
+    // Idle windows would only push the interesting ones out of the ring
+    if (current.frames > 0) {
+        current.timestamp      = timestamp;
+        current.duration       = time_interval(window_start, timestamp);
+        current.mem_high_water = memory_high_water();
+
+        xSemaphoreTake(sem, portMAX_DELAY);
+        if (count < INSTRUMENTATION_SAMPLES) {
+            samples[(first + count++) % INSTRUMENTATION_SAMPLES] = current;
+        } else {
+            samples[first] = current;
+            first          = (first + 1) % INSTRUMENTATION_SAMPLES;
+        }
+        xSemaphoreGive(sem);
+
+        if (current.handler_max_us > SLOW_HANDLER_US) {
+            ESP_LOGW(TAG, "Page %i: slow frame, handler took %u us (refresh %u ms)", current.page_id,
+                     (unsigned)current.handler_max_us, (unsigned)current.refresh_max_ms);
+        }
+    }
+
+    int page_id = current.page_id;
+    memset(&current, 0, sizeof(current));
+    current.page_id = page_id;
+    window_start    = timestamp;
+}
+
+
+static uint32_t memory_high_water(void) {
+#if LV_MEM_CUSTOM == 0
+    lv_mem_monitor_t monitor;
+    lv_mem_monitor(&monitor);
+    return monitor.max_used;
+#elif !defined(SIMULATOR)
+    // LVGL allocates from the system heap
+    return heap_caps_get_total_size(MALLOC_CAP_8BIT) - heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+#else
+    return 0;
+#endif
+}
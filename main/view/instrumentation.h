@@ -0,0 +1,32 @@
+#ifndef INSTRUMENTATION_H_INCLUDED
+#define INSTRUMENTATION_H_INCLUDED
+
+
+#include <stdint.h>
+#include <stdlib.h>
+
+
+/*
+ *  Rendering statistics, aggregated over one second or until the page changes
+ */
+typedef struct {
+    uint32_t timestamp;          // End of the window, ms
+    uint32_t duration;           // Length of the window, ms
+    int      page_id;            // Page shown during the window
+    uint16_t frames;             // Screen refreshes
+    uint16_t handler_calls;      // lv_timer_handler invocations
+    uint32_t handler_max_us;     // Longest lv_timer_handler invocation
+    uint32_t handler_total_us;   // Time spent in lv_timer_handler
+    uint32_t refresh_max_ms;     // Longest refresh (render and flush) as reported by LVGL
+    uint32_t flush_bytes;        // Bytes sent to the display
+    uint32_t mem_high_water;     // Most memory ever in use, bytes (0 when not available)
+} instrumentation_sample_t;
+
+
+void   instrumentation_init(void);
+void   instrumentation_record_handler(int page_id, uint32_t elapsed_us);
+void   instrumentation_record_refresh(uint32_t time_ms, uint32_t pixels);
+size_t instrumentation_get_samples(instrumentation_sample_t *samples, size_t max);
+
+
+#endif
@@ -71,18 +71,20 @@ static view_message_t page_event(model_t *pmodel, void *args, view_event_t event
 
                         case STANDBY_BTN_ID:
                             if (event.data.number > 0) {
-                                if (pmodel->configuration.standby_brightness + event.data.number * 5 <
+                                if (model_get_standby_brightness(pmodel) + event.data.number * 5 <
                                     APP_CONFIG_MAX_STANDBY_BRIGHTNESS) {
-                                    pmodel->configuration.standby_brightness += event.data.number * 5;
+                                    model_set_standby_brightness(
+                                        pmodel, model_get_standby_brightness(pmodel) + event.data.number * 5);
                                 } else {
-                                    pmodel->configuration.standby_brightness = APP_CONFIG_MAX_STANDBY_BRIGHTNESS;
+                                    model_set_standby_brightness(pmodel, APP_CONFIG_MAX_STANDBY_BRIGHTNESS);
                                 }
                             } else {
-                                if (pmodel->configuration.standby_brightness + event.data.number * 5 >
+                                if (model_get_standby_brightness(pmodel) + event.data.number * 5 >
                                     APP_CONFIG_MIN_STANDBY_BRIGHTNESS) {
-                                    pmodel->configuration.standby_brightness += event.data.number * 5;
+                                    model_set_standby_brightness(
+                                        pmodel, model_get_standby_brightness(pmodel) + event.data.number * 5);
                                 } else {
-                                    pmodel->configuration.standby_brightness = APP_CONFIG_MIN_STANDBY_BRIGHTNESS;
+                                    model_set_standby_brightness(pmodel, APP_CONFIG_MIN_STANDBY_BRIGHTNESS);
                                 }
                             }
                             update_page(pmodel, pdata);
@@ -90,18 +92,20 @@ static view_message_t page_event(model_t *pmodel, void *args, view_event_t event
 
                         case NORMAL_BTN_ID:
                             if (event.data.number > 0) {
-                                if (pmodel->configuration.normal_brightness + event.data.number * 5 <
+                                if (model_get_normal_brightness(pmodel) + event.data.number * 5 <
                                     APP_CONFIG_MAX_NORMAL_BRIGHTNESS) {
-                                    pmodel->configuration.normal_brightness += event.data.number * 5;
+                                    model_set_normal_brightness(
+                                        pmodel, model_get_normal_brightness(pmodel) + event.data.number * 5);
                                 } else {
-                                    pmodel->configuration.normal_brightness = APP_CONFIG_MAX_NORMAL_BRIGHTNESS;
+                                    model_set_normal_brightness(pmodel, APP_CONFIG_MAX_NORMAL_BRIGHTNESS);
                                 }
                             } else {
-                                if (pmodel->configuration.normal_brightness + event.data.number * 5 >
+                                if (model_get_normal_brightness(pmodel) + event.data.number * 5 >
                                     APP_CONFIG_MIN_NORMAL_BRIGHTNESS) {
-                                    pmodel->configuration.normal_brightness += event.data.number * 5;
+                                    model_set_normal_brightness(
+                                        pmodel, model_get_normal_brightness(pmodel) + event.data.number * 5);
                                 } else {
-                                    pmodel->configuration.normal_brightness = APP_CONFIG_MIN_NORMAL_BRIGHTNESS;
+                                    model_set_normal_brightness(pmodel, APP_CONFIG_MIN_NORMAL_BRIGHTNESS);
                                 }
                             }
                             update_page(pmodel, pdata);
@@ -88,7 +88,9 @@ static view_message_t page_event(model_t *pmodel, void *args, view_event_t event
             break;
 
         case VIEW_EVENT_CODE_UPDATE:
-            update_page(pmodel, pdata);
+            if (event.changes & MODEL_CHANGE_FIRMWARE_VERSION) {
+                update_page(pmodel, pdata);
+            }
             break;
 
         case VIEW_EVENT_CODE_LVGL: {
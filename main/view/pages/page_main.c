@@ -3,6 +3,7 @@
 #include "model/model.h"
 #include "view/view.h"
 #include "view/common.h"
+#include "view/fan_frames.h"
 #include "view/view_types.h"
 #include "view/theme/style.h"
 #include "view/intl/intl.h"
@@ -35,10 +36,12 @@ struct page_data {
     lv_obj_t *arc_speed;
     lv_obj_t *settings_cont;
     lv_obj_t *img_communication;
+    lv_obj_t *screen;
     lv_anim_t anim_fans[MAX_FANS];
 
-    uint8_t anim_state[MAX_FANS];
-    size_t  fan_index;
+    uint8_t  anim_state[MAX_FANS];
+    size_t   fan_index;
+    uint16_t num_fans;
 
     lv_timer_t *timer_screensaver;
 };
@@ -47,8 +50,9 @@ struct page_data {
 static const char *TAG = "PageMain";
 
 
+static void      build_page(model_t *pmodel, struct page_data *pdata);
 static lv_obj_t *fan_button_create(lv_obj_t *root, const char *text);
-static void      update_page(model_t *pmodel, struct page_data *pdata);
+static void      update_page(model_t *pmodel, struct page_data *pdata, uint32_t changes);
 static lv_anim_t fan_animation(lv_obj_t *img, uint32_t period);
 static lv_obj_t *fan_enable_button_create(lv_obj_t *root);
 static uint16_t  anim_period_from_speed(uint16_t speed);
@@ -70,8 +74,14 @@ static void *create_page(model_t *pmodel, void *extra) {
 
 static void open_page(model_t *pmodel, void *args) {
     struct page_data *pdata = args;
+    pdata->screen           = view_retained_screen_create();
+    build_page(pmodel, pdata);
+}
+
 
+static void build_page(model_t *pmodel, struct page_data *pdata) {
     lv_timer_reset(pdata->timer_screensaver);
+    pdata->num_fans = pmodel->configuration.num_fans;
 
     uint16_t main_area_width = LV_HOR_RES_MAX;
 
@@ -203,7 +213,7 @@ static void open_page(model_t *pmodel, void *args) {
     lv_obj_center(img);
 
 
-    update_page(pmodel, pdata);
+    update_page(pmodel, pdata, MODEL_CHANGE_ALL);
 }
 
 
@@ -213,17 +223,17 @@ static view_message_t page_event(model_t *pmodel, void *args, view_event_t event
 
     switch (event.code) {
         case VIEW_EVENT_CODE_UPDATE:
-            update_page(pmodel, pdata);
+            update_page(pmodel, pdata, event.changes);
             break;
 
         case VIEW_EVENT_CODE_TIMER: {
             if (model_get_fan_on(pmodel, 0) || model_get_fan_on(pmodel, 1) || model_get_fan_on(pmodel, 2)) {
                 // Do nothing
             } else {
-                msg.vmsg.code       = VIEW_PAGE_MESSAGE_CODE_CHANGE_PAGE_EXTRA;
-                msg.vmsg.extra      = (void *)(uintptr_t)1;
-                msg.vmsg.page       = (void *)&page_splash;
-                pmodel->run.standby = 1;
+                msg.vmsg.code  = VIEW_PAGE_MESSAGE_CODE_CHANGE_PAGE_EXTRA;
+                msg.vmsg.extra = (void *)(uintptr_t)1;
+                msg.vmsg.page  = (void *)&page_splash;
+                model_set_standby(pmodel, 1);
             }
             break;
         }
@@ -236,12 +246,12 @@ static view_message_t page_event(model_t *pmodel, void *args, view_event_t event
                     switch (event.data.id) {
                         case FAN_BTN_ID:
                             pdata->fan_index = event.data.number;
-                            update_page(pmodel, pdata);
+                            update_page(pmodel, pdata, MODEL_CHANGE_FANS);
                             break;
 
                         case LIGHT_ENABLE_BTN_ID:
                             model_toggle_light_on(pmodel, pdata->fan_index);
-                            update_page(pmodel, pdata);
+                            update_page(pmodel, pdata, MODEL_CHANGE_FANS);
 
                             msg.cmsg.code  = VIEW_CONTROLLER_MESSAGE_CODE_SET_LIGHT;
                             msg.cmsg.value = model_get_light_on(pmodel, pdata->fan_index);
@@ -250,7 +260,7 @@ static view_message_t page_event(model_t *pmodel, void *args, view_event_t event
 
                         case FAN_ENABLE_BTN_ID:
                             model_toggle_fan_on(pmodel, pdata->fan_index);
-                            update_page(pmodel, pdata);
+                            update_page(pmodel, pdata, MODEL_CHANGE_FANS);
 
                             if (model_get_fan_on(pmodel, pdata->fan_index) &&
                                 model_get_fan_speed(pmodel, pdata->fan_index) > 0) {
@@ -274,7 +284,7 @@ static view_message_t page_event(model_t *pmodel, void *args, view_event_t event
                             model_set_fan_speed(pmodel, pdata->fan_index,
                                                 model_get_minimum_speed(pmodel, pdata->fan_index) +
                                                     lv_arc_get_value(pdata->arc_speed));
-                            update_page(pmodel, pdata);
+                            update_page(pmodel, pdata, MODEL_CHANGE_FANS);
 
                             if (model_get_fan_on(pmodel, pdata->fan_index) &&
                                 model_get_fan_speed(pmodel, pdata->fan_index) > 0) {
@@ -334,8 +344,15 @@ static view_message_t page_event(model_t *pmodel, void *args, view_event_t event
 }
 
 
-static void update_page(model_t *pmodel, struct page_data *pdata) {
-    view_common_set_hidden(pdata->img_communication, !model_get_communication_error(pmodel));
+static void update_page(model_t *pmodel, struct page_data *pdata, uint32_t changes) {
+    if (changes & MODEL_CHANGE_COMMUNICATION) {
+        view_common_set_hidden(pdata->img_communication, !model_get_communication_error(pmodel));
+    }
+
+    // Everything else on the page is bound to the fans
+    if ((changes & MODEL_CHANGE_FANS) == 0) {
+        return;
+    }
 
     for (size_t i = 0; i < MAX_FANS; i++) {
         if (pdata->btn_fans[i] != NULL) {
@@ -419,8 +436,8 @@ static lv_obj_t *fan_button_create(lv_obj_t *root, const char *text) {
 static lv_anim_t fan_animation(lv_obj_t *img, uint32_t period) {
     lv_anim_t a;
     lv_anim_init(&a);
-    /*Set the "animator" function*/
-    lv_anim_set_exec_cb(&a, (lv_anim_exec_xcb_t)(void *)lv_img_set_angle);
+    /*Set the "animator" function; pre-rotated frames spare the software rotation of each refresh*/
+    lv_anim_set_exec_cb(&a, fan_frames_set_angle);
     /*Set target of the animation*/
     lv_anim_set_var(&a, img);
     /*Length of the animation [ms]*/
@@ -482,10 +499,58 @@ static void snap_event_handler(lv_event_t *e) {
 }
 
 
+static void hide_page(void *args) {
+    struct page_data *pdata = args;
+    lv_timer_pause(pdata->timer_screensaver);
+
+    // Animations would keep running on the hidden widgets
+    for (size_t i = 0; i < MAX_FANS; i++) {
+        if (pdata->anim_fans[i].var != NULL) {
+            lv_anim_custom_del(&pdata->anim_fans[i], NULL);
+        }
+    }
+
+    view_retained_screen_hide();
+}
+
+
+static void show_page(model_t *pmodel, void *args) {
+    struct page_data *pdata = args;
+    view_retained_screen_show(pdata->screen);
+
+    // The layout depends on the number of fans, which may have been changed from the settings
+    if (pdata->num_fans != pmodel->configuration.num_fans) {
+        lv_obj_clean(pdata->screen);
+        build_page(pmodel, pdata);
+        return;
+    }
+
+    lv_timer_reset(pdata->timer_screensaver);
+
+    for (size_t i = 0; i < MAX_FANS; i++) {
+        if (pdata->btn_fans[i] != NULL) {
+            lv_label_set_text(lv_obj_get_child(pdata->btn_fans[i], 2), model_get_fan_name(pmodel, i));
+        }
+
+        if (pdata->anim_fans[i].var == NULL) {
+            continue;
+        } else if (model_get_fan_on(pmodel, i) && model_get_fan_speed(pmodel, i) > 0) {
+            lv_anim_set_time(&pdata->anim_fans[i], anim_period_from_speed(model_get_fan_speed(pmodel, i)));
+            lv_anim_start(&pdata->anim_fans[i]);
+            pdata->anim_state[i] = 1;
+        } else {
+            pdata->anim_state[i] = 0;
+        }
+    }
+
+    update_page(pmodel, pdata, MODEL_CHANGE_ALL);
+}
+
+
 static void close_page(void *args) {
     struct page_data *pdata = args;
     lv_timer_pause(pdata->timer_screensaver);
-    lv_obj_clean(lv_scr_act());
+    view_retained_screen_delete(pdata->screen);
 }
 
 
@@ -498,9 +563,13 @@ static void destroy_page(void *args, void *extra) {
 
 
 const pman_page_t page_main = {
+    .id            = PAGE_ID_MAIN,
     .create        = create_page,
     .destroy       = destroy_page,
     .open          = open_page,
     .close         = close_page,
+    .hide          = hide_page,
+    .show          = show_page,
+    .retain        = 8 * 1024,
     .process_event = page_event,
 };
@@ -17,7 +17,9 @@ enum {
 };
 
 
-struct page_data {};
+struct page_data {
+    lv_obj_t *screen;
+};
 
 
 static void      update_page(model_t *pmodel, struct page_data *pdata);
@@ -34,6 +36,8 @@ static void *create_page(model_t *pmodel, void *extra) {
 static void open_page(model_t *pmodel, void *args) {
     struct page_data *pdata = args;
 
+    pdata->screen = view_retained_screen_create();
+
     lv_obj_t *cont = lv_obj_create(lv_scr_act());
     lv_obj_set_size(cont, LV_HOR_RES, LV_VER_RES);
     lv_obj_align(cont, LV_ALIGN_CENTER, 0, 0);
@@ -113,10 +117,22 @@ static view_message_t page_event(model_t *pmodel, void *args, view_event_t event
 }
 
 
+static void hide_page(void *args) {
+    (void)args;
+    view_retained_screen_hide();
+}
+
+
+static void show_page(model_t *pmodel, void *args) {
+    struct page_data *pdata = args;
+    view_retained_screen_show(pdata->screen);
+    update_page(pmodel, pdata);
+}
+
+
 static void close_page(void *args) {
     struct page_data *pdata = args;
-    (void)pdata;
-    lv_obj_clean(lv_scr_act());
+    view_retained_screen_delete(pdata->screen);
 }
 
 
@@ -143,9 +159,13 @@ static lv_obj_t *menu_btn_create(lv_obj_t *root, const char *text) {
 
 
 const pman_page_t page_menu = {
+    .id            = PAGE_ID_MENU,
     .create        = create_page,
     .destroy       = destroy_page,
     .open          = open_page,
     .close         = close_page,
+    .hide          = hide_page,
+    .show          = show_page,
+    .retain        = 2 * 1024,
     .process_event = page_event,
 };
@@ -3,6 +3,7 @@
 #include "model/model.h"
 #include "view/view.h"
 #include "view/common.h"
+#include "view/fan_frames.h"
 #include "view/view_types.h"
 #include "view/theme/style.h"
 #include "view/intl/intl.h"
@@ -39,7 +40,7 @@ struct page_data {
 
 
 static lv_obj_t *fan_button_create(lv_obj_t *root, const char *text);
-static void      update_page(model_t *pmodel, struct page_data *pdata);
+static void      update_page(model_t *pmodel, struct page_data *pdata, uint32_t changes);
 static lv_anim_t fan_animation(lv_obj_t *img, uint32_t period);
 static lv_obj_t *fan_enable_button_create(lv_obj_t *root);
 static uint16_t  anim_period_from_speed(uint16_t speed);
@@ -161,7 +162,7 @@ static void open_page(model_t *pmodel, void *args) {
 
     model_set_fan_speed(pmodel, pdata->fan_index, model_get_minimum_speed(pmodel, pdata->fan_index));
 
-    update_page(pmodel, pdata);
+    update_page(pmodel, pdata, MODEL_CHANGE_ALL);
 }
 
 
@@ -171,7 +172,7 @@ static view_message_t page_event(model_t *pmodel, void *args, view_event_t event
 
     switch (event.code) {
         case VIEW_EVENT_CODE_UPDATE:
-            update_page(pmodel, pdata);
+            update_page(pmodel, pdata, event.changes);
             break;
 
         case VIEW_EVENT_CODE_TIMER: {
@@ -194,12 +195,12 @@ static view_message_t page_event(model_t *pmodel, void *args, view_event_t event
                             pdata->fan_index = event.data.number;
                             model_set_fan_speed(pmodel, pdata->fan_index,
                                                 model_get_minimum_speed(pmodel, pdata->fan_index));
-                            update_page(pmodel, pdata);
+                            update_page(pmodel, pdata, MODEL_CHANGE_FANS);
                             break;
 
                         case FAN_ENABLE_BTN_ID:
                             model_toggle_fan_on(pmodel, pdata->fan_index);
-                            update_page(pmodel, pdata);
+                            update_page(pmodel, pdata, MODEL_CHANGE_FANS);
 
                             if (model_get_fan_on(pmodel, pdata->fan_index) &&
                                 model_get_fan_speed(pmodel, pdata->fan_index) > 0) {
@@ -224,7 +225,7 @@ static view_message_t page_event(model_t *pmodel, void *args, view_event_t event
 
                             model_set_fan_speed(pmodel, pdata->fan_index, speed);
                             model_set_minimum_speed(pmodel, pdata->fan_index, speed);
-                            update_page(pmodel, pdata);
+                            update_page(pmodel, pdata, MODEL_CHANGE_FANS);
 
                             if (model_get_fan_on(pmodel, pdata->fan_index) &&
                                 model_get_fan_speed(pmodel, pdata->fan_index) > 0) {
@@ -280,8 +281,14 @@ static view_message_t page_event(model_t *pmodel, void *args, view_event_t event
 }
 
 
-static void update_page(model_t *pmodel, struct page_data *pdata) {
-    view_common_set_hidden(pdata->img_communication, !model_get_communication_error(pmodel));
+static void update_page(model_t *pmodel, struct page_data *pdata, uint32_t changes) {
+    if (changes & MODEL_CHANGE_COMMUNICATION) {
+        view_common_set_hidden(pdata->img_communication, !model_get_communication_error(pmodel));
+    }
+
+    if ((changes & MODEL_CHANGE_FANS) == 0) {
+        return;
+    }
 
     for (size_t i = 0; i < MAX_FANS; i++) {
         if (pdata->btn_fans[i] != NULL) {
@@ -341,8 +348,8 @@ static lv_obj_t *fan_button_create(lv_obj_t *root, const char *text) {
 static lv_anim_t fan_animation(lv_obj_t *img, uint32_t period) {
     lv_anim_t a;
     lv_anim_init(&a);
-    /*Set the "animator" function*/
-    lv_anim_set_exec_cb(&a, (lv_anim_exec_xcb_t)(void *)lv_img_set_angle);
+    /*Set the "animator" function; pre-rotated frames spare the software rotation of each refresh*/
+    lv_anim_set_exec_cb(&a, fan_frames_set_angle);
     /*Set target of the animation*/
     lv_anim_set_var(&a, img);
     /*Length of the animation [ms]*/
@@ -101,8 +101,8 @@ static view_message_t page_event(model_t *pmodel, void *args, view_event_t event
 
                     switch (event.data.id) {
                         case SCREEN_BTN_ID:
-                            pmodel->run.standby = 0;
-                            msg.vmsg.code       = VIEW_PAGE_MESSAGE_CODE_BACK;
+                            model_set_standby(pmodel, 0);
+                            msg.vmsg.code = VIEW_PAGE_MESSAGE_CODE_BACK;
                             break;
                     }
                     break;
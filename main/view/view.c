@@ -1,12 +1,15 @@
 #include <stdlib.h>
+#include <assert.h>
 #include "gel/collections/queue.h"
 #include "gel/pagemanager/page_manager.h"
 #include "config/app_config.h"
 #include "model/model.h"
 #include "view.h"
+#include "instrumentation.h"
 #include "theme/style.h"
 #include "theme/theme.h"
 #include "utils/utils.h"
+#include "utils/wakeup.h"
 #include "gel/timer/timecheck.h"
 #include "esp_log.h"
 
@@ -16,24 +19,45 @@
 #ifdef SIMULATOR
 #define BUFFER_SIZE (DISPLAY_HORIZONTAL_RESOLUTION * 200)
 #else
+#include "esp_heap_caps.h"
 #include "lvgl_helpers.h"
-#define BUFFER_SIZE DISP_BUF_SIZE
+#define BUFFER_SIZE (DISPLAY_HORIZONTAL_RESOLUTION * CONFIG_APP_DISPLAY_BUFFER_LINES)
 #endif
 
 
-QUEUE_DECLARATION(event_queue, view_event_t, 16);
+#define EVENT_QUEUE_SIZE 32
+#define MAX_TIMER_CODES  32
+
+
+QUEUE_DECLARATION(event_queue, view_event_t, EVENT_QUEUE_SIZE);
 QUEUE_DEFINITION(event_queue, view_event_t);
 
 
+static void flush_events(void);
+static int  next_event(view_event_t *event);
+static void queue_event(struct event_queue *queue, view_event_t *event);
+static int  merge_pressing(view_event_t *event);
 static void periodic_timer_callback(lv_timer_t *timer);
 static void free_user_data_callback(lv_event_t *event);
 static void event_callback(lv_event_t *event);
+static void monitor_callback(lv_disp_drv_t *disp_drv, uint32_t time, uint32_t px);
 
 
 static const char        *TAG = "View";
-static struct event_queue q;
 static page_manager_t     pman;
 static lv_indev_t        *touch_indev;
+static lv_obj_t          *shared_screen;
+
+/*
+ *  User input has its own queue and is served first, so that it cannot be crowded out by the controller.
+ *  UPDATE and TIMER events carry no data besides the change mask and the timer code and only need to be seen once:
+ *  they are kept as pending masks and delivered last.
+ */
+static struct event_queue q;
+static struct event_queue input_q;
+static uint32_t           update_pending = 0;
+static uint32_t           timers_pending = 0;
+static view_event_stats_t stats          = {0};
 
 
 void view_init(model_t *pmodel,
@@ -45,22 +69,40 @@ void view_init(model_t *pmodel,
     /*A static or global variable to store the buffers*/
     static lv_disp_draw_buf_t disp_buf;
 
+#ifdef SIMULATOR
     /*Static or global buffer(s). The second buffer is optional*/
     static lv_color_t buf_1[BUFFER_SIZE] = {0};
+    lv_color_t       *buf_2              = NULL;
+#else
+    /*
+     * With two buffers LVGL can render the next stripe while the previous one is being flushed, which only pays off
+     * if the flush returns before the transfer is over (see CONFIG_APP_DISPLAY_DOUBLE_BUFFER)
+     */
+    lv_color_t *buf_1 = heap_caps_malloc(BUFFER_SIZE * sizeof(lv_color_t), MALLOC_CAP_DMA);
+    assert(buf_1 != NULL);
+#ifdef CONFIG_APP_DISPLAY_DOUBLE_BUFFER
+    lv_color_t *buf_2 = heap_caps_malloc(BUFFER_SIZE * sizeof(lv_color_t), MALLOC_CAP_DMA);
+    assert(buf_2 != NULL);
+#else
+    lv_color_t *buf_2 = NULL;
+#endif
+#endif
 
     /*Initialize `disp_buf` with the buffer(s). With only one buffer use NULL instead buf_2 */
-    lv_disp_draw_buf_init(&disp_buf, buf_1, NULL, BUFFER_SIZE);
+    lv_disp_draw_buf_init(&disp_buf, buf_1, buf_2, BUFFER_SIZE);
 
     static lv_disp_drv_t disp_drv;                     /*A variable to hold the drivers. Must be static or global.*/
     lv_disp_drv_init(&disp_drv);                       /*Basic initialization*/
-    disp_drv.draw_buf = &disp_buf;                     /*Set an initialized buffer*/
-    disp_drv.flush_cb = flush_cb;                      /*Set a flush callback to draw to the display*/
-    disp_drv.hor_res  = DISPLAY_HORIZONTAL_RESOLUTION; /*Set the horizontal resolution in pixels*/
-    disp_drv.ver_res  = DISPLAY_VERTICAL_RESOLUTION;   /*Set the vertical resolution in pixels*/
+    disp_drv.draw_buf   = &disp_buf;                     /*Set an initialized buffer*/
+    disp_drv.flush_cb   = flush_cb;                      /*Set a flush callback to draw to the display*/
+    disp_drv.hor_res    = DISPLAY_HORIZONTAL_RESOLUTION; /*Set the horizontal resolution in pixels*/
+    disp_drv.ver_res    = DISPLAY_VERTICAL_RESOLUTION;   /*Set the vertical resolution in pixels*/
+    disp_drv.monitor_cb = monitor_callback;              /*Called after every refresh with its duration and size*/
 
     lv_disp_t *disp = lv_disp_drv_register(&disp_drv); /*Register the driver and save the created display objects*/
     style_init();
     theme_init(disp);
+    shared_screen = lv_scr_act();
 
     static lv_indev_drv_t indev_drv;
     lv_indev_drv_init(&indev_drv); /*Basic initialization*/
@@ -71,7 +113,8 @@ void view_init(model_t *pmodel,
     touch_indev = lv_indev_drv_register(&indev_drv);
 
     pman_init(&pman);
-    event_queue_init(&q);
+    flush_events();
+    instrumentation_init();
 }
 
 
@@ -85,8 +128,37 @@ int view_current_page_id(void) {
 }
 
 
+/*
+ *  Retained pages build on a screen of their own, so that navigating away and back only swaps the screen.
+ *  Every other page uses the shared one.
+ */
+lv_obj_t *view_retained_screen_create(void) {
+    lv_obj_t *screen = lv_obj_create(NULL);
+    lv_scr_load(screen);
+    return screen;
+}
+
+
+void view_retained_screen_show(lv_obj_t *screen) {
+    lv_scr_load(screen);
+}
+
+
+void view_retained_screen_hide(void) {
+    lv_scr_load(shared_screen);
+}
+
+
+void view_retained_screen_delete(lv_obj_t *screen) {
+    if (lv_scr_act() == screen) {
+        lv_scr_load(shared_screen);
+    }
+    lv_obj_del(screen);
+}
+
+
 pman_view_t view_change_page_extra(model_t *pmodel, const pman_page_t *page, void *extra) {
-    event_queue_init(&q);     // Butta tutti gli eventi precedenti quando cambi la pagina
+    flush_events(); // Butta tutti gli eventi precedenti quando cambi la pagina
     view_event((view_event_t){.code = VIEW_EVENT_CODE_OPEN});
     view_wait_release();
     return pman_change_page_extra(&pman, pmodel, *page, extra);
@@ -99,7 +171,7 @@ pman_view_t view_change_page(model_t *pmodel, const pman_page_t *page) {
 
 
 pman_view_t view_swap_page_extra(model_t *pmodel, const pman_page_t *page, void *extra) {
-    event_queue_init(&q);
+    flush_events();
     view_event((view_event_t){.code = VIEW_EVENT_CODE_OPEN});
     view_wait_release();
     return pman_swap_page_extra(&pman, pmodel, *(pman_page_t *)page, extra);
@@ -112,7 +184,7 @@ pman_view_t view_swap_page(model_t *pmodel, const pman_page_t *page) {
 
 
 pman_view_t view_back(model_t *pmodel) {
-    event_queue_init(&q);
+    flush_events();
     view_event((view_event_t){.code = VIEW_EVENT_CODE_OPEN});
     view_wait_release();
     return pman_back(&pman, pmodel);
@@ -120,7 +192,7 @@ pman_view_t view_back(model_t *pmodel) {
 
 
 pman_view_t view_rebase_page(model_t *pmodel, const pman_page_t *page) {
-    event_queue_init(&q);
+    flush_events();
     view_event((view_event_t){.code = VIEW_EVENT_CODE_OPEN});
     view_wait_release();
     return pman_rebase_page(&pman, pmodel, *(pman_page_t *)page);
@@ -128,7 +200,7 @@ pman_view_t view_rebase_page(model_t *pmodel, const pman_page_t *page) {
 
 
 pman_view_t view_reset_to_page(model_t *pmodel, int id) {
-    event_queue_init(&q);
+    flush_events();
     view_event((view_event_t){.code = VIEW_EVENT_CODE_OPEN});
     view_wait_release();
     return pman_reset_to_page(&pman, pmodel, id);
@@ -137,12 +209,7 @@ pman_view_t view_reset_to_page(model_t *pmodel, int id) {
 
 int view_get_next_msg(model_t *pmodel, view_message_t *msg, view_event_t *eventcopy) {
     view_event_t event;
-    int          found = 0;
-
-    if (!event_queue_is_empty(&q)) {
-        event_queue_dequeue(&q, &event);
-        found = 1;
-    }
+    int          found = next_event(&event);
 
     if (found) {
         *msg = pman.current_page.process_event(pmodel, pman.current_page.data, event);
@@ -193,9 +260,49 @@ int view_process_msg(view_page_message_t vmsg, model_t *pmodel) {
 
 
 void view_event(view_event_t event) {
-    if (event_queue_enqueue(&q, &event)) {
-        ESP_LOGI(TAG, "View event queue was full!");
+    switch (event.code) {
+        case VIEW_EVENT_CODE_UPDATE:
+            if (update_pending) {
+                stats.coalesced++;
+            }
+            // The pages are told about everything that changed since they last refreshed
+            update_pending |= event.changes != 0 ? event.changes : MODEL_CHANGE_ALL;
+            break;
+
+        case VIEW_EVENT_CODE_TIMER:
+            if (event.timer_code >= 0 && event.timer_code < MAX_TIMER_CODES) {
+                if (timers_pending & (1UL << event.timer_code)) {
+                    stats.coalesced++;
+                }
+                timers_pending |= 1UL << event.timer_code;
+            } else {
+                queue_event(&q, &event);
+            }
+            break;
+
+        case VIEW_EVENT_CODE_LVGL:
+            if (merge_pressing(&event)) {
+                stats.coalesced++;
+            } else {
+                queue_event(&input_q, &event);
+            }
+            break;
+
+        default:
+            queue_event(&q, &event);
+            break;
     }
+
+    wakeup_notify();
+}
+
+
+/*
+ *  Meant to be read from other tasks too (i.e. the HTTP server): the counters are word sized, at worst one is stale
+ */
+void view_get_event_stats(view_event_stats_t *out) {
+    *out       = stats;
+    out->depth = (uint16_t)(q.write_idx - q.read_idx) + (uint16_t)(input_q.write_idx - input_q.read_idx);
 }
 
 
@@ -288,7 +395,74 @@ static void event_callback(lv_event_t *event) {
 }
 
 
+static void flush_events(void) {
+    event_queue_init(&q);
+    event_queue_init(&input_q);
+    update_pending = 0;
+    timers_pending = 0;
+}
+
+
+static int next_event(view_event_t *event) {
+    if (event_queue_dequeue(&input_q, event) == DEQUEUE_RESULT_SUCCESS) {
+        return 1;
+    } else if (event_queue_dequeue(&q, event) == DEQUEUE_RESULT_SUCCESS) {
+        return 1;
+    } else if (timers_pending) {
+        int code = __builtin_ctz(timers_pending);
+        timers_pending &= ~(1UL << code);
+        *event = (view_event_t){.code = VIEW_EVENT_CODE_TIMER, .timer_code = code};
+        return 1;
+    } else if (update_pending) {
+        *event         = (view_event_t){.code = VIEW_EVENT_CODE_UPDATE, .changes = update_pending};
+        update_pending = 0;
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+
+static void queue_event(struct event_queue *queue, view_event_t *event) {
+    if (event_queue_enqueue(queue, event) == ENQUEUE_RESULT_FULL) {
+        stats.dropped++;
+        ESP_LOGW(TAG, "View event queue was full! (%u dropped so far)", (unsigned)stats.dropped);
+        return;
+    }
+
+    uint16_t depth = (uint16_t)(q.write_idx - q.read_idx) + (uint16_t)(input_q.write_idx - input_q.read_idx);
+    if (depth > stats.max_depth) {
+        stats.max_depth = depth;
+    }
+}
+
+
+/*
+ *  A long press emits PRESSING continuously; only the latest one for the same object is worth keeping
+ */
+static int merge_pressing(view_event_t *event) {
+    if (event->event != LV_EVENT_PRESSING || event_queue_is_empty(&input_q)) {
+        return 0;
+    }
+
+    view_event_t *last = &input_q.items[(uint16_t)(input_q.write_idx - 1) & (EVENT_QUEUE_SIZE - 1)];
+    if (last->event == LV_EVENT_PRESSING && last->data.id == event->data.id &&
+        last->data.number == event->data.number) {
+        *last = *event;
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+
 static void periodic_timer_callback(lv_timer_t *timer) {
     int code = (int)(uintptr_t)timer->user_data;
     view_event((view_event_t){.code = VIEW_EVENT_CODE_TIMER, .timer_code = code});
-}
\ No newline at end of file
+}
+
+
+static void monitor_callback(lv_disp_drv_t *disp_drv, uint32_t time, uint32_t px) {
+    (void)disp_drv;
+    instrumentation_record_refresh(time, px);
+}
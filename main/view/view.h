@@ -8,6 +8,8 @@
 
 
 #define PAGE_ID_FIRMWARE_UPDATE 1
+#define PAGE_ID_MAIN            2
+#define PAGE_ID_MENU            3
 
 
 void view_init(model_t *pmodel,
@@ -31,7 +33,12 @@ lv_timer_t *view_register_periodic_timer(size_t period, int code);
 void        view_register_object_default_callback_with_number(lv_obj_t *obj, int id, int number);
 void        view_register_object_default_callback(lv_obj_t *obj, int id);
 void        view_event(view_event_t event);
+void        view_get_event_stats(view_event_stats_t *stats);
 int         view_current_page_id(void);
+lv_obj_t   *view_retained_screen_create(void);
+void        view_retained_screen_show(lv_obj_t *screen);
+void        view_retained_screen_hide(void);
+void        view_retained_screen_delete(lv_obj_t *screen);
 
 
 extern const pman_page_t page_main, page_splash, page_password, page_settings, page_minimum_speed, page_immission_speed,
@@ -73,7 +73,8 @@ typedef struct {
     view_event_code_t code;
 
     union {
-        int timer_code;
+        int      timer_code;
+        uint32_t changes; // UPDATE: mask of model_change_t
         struct {
             lv_event_code_t    event;
             view_object_data_t data;
@@ -84,6 +85,14 @@ typedef struct {
 } view_event_t;
 
 
+typedef struct {
+    uint32_t dropped;
+    uint32_t coalesced;
+    uint16_t depth;
+    uint16_t max_depth;
+} view_event_stats_t;
+
+
 typedef enum {
     VIEW_PAGE_MESSAGE_CODE_NOTHING = 0,
     VIEW_PAGE_MESSAGE_CODE_CHANGE_PAGE,
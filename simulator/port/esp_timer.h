@@ -0,0 +1,8 @@
+#ifndef ESP_TIMER_H_INCLUDED
+#define ESP_TIMER_H_INCLUDED
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+
+#endif
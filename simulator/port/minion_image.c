@@ -0,0 +1,16 @@
+#include "peripherals/minion_image.h"
+
+
+int minion_image_begin(size_t size) {
+    return -1;
+}
+
+
+int minion_image_write(const uint8_t *data, size_t len) {
+    return -1;
+}
+
+
+int minion_image_read(size_t offset, void *data, size_t len) {
+    return -1;
+}
@@ -6,7 +6,15 @@ int rs485_read(uint8_t *buffer, size_t len, unsigned long timeout_ms) {
 }
 
 
+int rs485_receive_frame(uint8_t *buffer, size_t len, unsigned long timeout_ms) {
+    return 0;
+}
+
+
 void rs485_write(uint8_t *buffer, size_t len) {}
 
 
 void rs485_flush(void) {}
+
+
+void rs485_set_baud_rate(uint32_t baud_rate) {}
@@ -3,4 +3,12 @@
 
 firmware_update_state_t server_firmware_update_state(void) {
     return FIRMWARE_UPDATE_STATE_NONE;
-}
\ No newline at end of file
+}
+
+
+uint8_t server_take_minion_update(size_t *size, uint32_t *crc, uint8_t *device_mask) {
+    return 0;
+}
+
+
+void server_minion_update_done(void) {}
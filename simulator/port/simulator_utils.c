@@ -1,5 +1,6 @@
 
 #ifdef __MINGW32__
+#include <stdint.h>
 #include <windows.h>
 
 LARGE_INTEGER
@@ -68,8 +69,16 @@ unsigned long get_millis(void) {
     now_ms = ts.tv_sec * 1000UL + ts.tv_usec / 1000UL;
     return now_ms;
 }
+
+
+int64_t esp_timer_get_time(void) {
+    struct timeval ts;
+    clock_gettime(0, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_usec;
+}
 #else
 
+#include <stdint.h>
 #include <time.h>
 #include <sys/time.h>
 
@@ -82,4 +91,11 @@ unsigned long get_millis(void) {
     return now_ms;
 }
 
+
+int64_t esp_timer_get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000LL;
+}
+
 #endif
\ No newline at end of file
@@ -23,6 +23,12 @@ static int    save_number(double value, char *key);
 void storage_init(void) {}
 
 
+void storage_session_open(void) {}
+
+
+void storage_session_close(void) {}
+
+
 int storage_load_double(double *value, char *key) {
     double number = 0;
     if (load_number(&number, key)) {
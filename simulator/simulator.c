@@ -7,6 +7,10 @@
 #include "view/view.h"
 #include "controller/controller.h"
 #include "controller/gui.h"
+#include "utils/wakeup.h"
+
+
+#define MAX_IDLE_PERIOD 1000
 
 
 static const char *TAG = "Main";
@@ -16,6 +20,7 @@ void app_main(void *arg) {
     model_t model;
     (void)arg;
 
+    wakeup_init();
     lv_init();
     sdl_init();
 
@@ -25,10 +30,13 @@ void app_main(void *arg) {
 
     ESP_LOGI(TAG, "Begin main loop");
     for (;;) {
-        controller_gui_manage(&model);
-        controller_manage(&model);
+        uint32_t next_timer = controller_gui_manage(&model);
+        uint32_t next_work  = controller_manage(&model);
+        if (next_work < next_timer) {
+            next_timer = next_work;
+        }
 
-        vTaskDelay(pdMS_TO_TICKS(5));
+        wakeup_wait(next_timer < MAX_IDLE_PERIOD ? next_timer : MAX_IDLE_PERIOD);
     }
 
     vTaskDelete(NULL);
@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""
+Builds a delta update: a compressed patch that turns the firmware currently running on the device into a new one.
+It is sent to PUT /firmware_update just like a full image; the device rejects it if it was made against a
+different firmware. Requires the bsdiff4 package.
+
+    python3 tools/mkdelta.py running.bin new.bin update.gz
+"""
+import argparse
+import gzip
+import struct
+import sys
+
+import bsdiff4.core
+
+DELTA_MAGIC = b'HSWD'
+ESP_IMAGE_MAGIC = 0xE9
+HASH_APPENDED_OFFSET = 23
+SHA256_SIZE = 32
+
+
+def image_sha256(image: bytes, name: str) -> bytes:
+    # The device identifies the running image by the SHA256 appended to it
+    if len(image) <= HASH_APPENDED_OFFSET or image[0] != ESP_IMAGE_MAGIC or image[HASH_APPENDED_OFFSET] != 1:
+        sys.exit(f'{name} is not an application image with an appended SHA256')
+    return image[-SHA256_SIZE:]
+
+
+def make_delta(source: bytes, target: bytes) -> bytes:
+    control, diff, extra = bsdiff4.core.diff(source, target)
+
+    patch = bytearray(DELTA_MAGIC)
+    patch += struct.pack('<II', len(source), len(target))
+    patch += image_sha256(source, 'The source')
+
+    diff_pos = 0
+    extra_pos = 0
+    for diff_len, extra_len, seek in control:
+        patch += struct.pack('<IIi', diff_len, extra_len, seek)
+        patch += diff[diff_pos:diff_pos + diff_len]
+        patch += extra[extra_pos:extra_pos + extra_len]
+        diff_pos += diff_len
+        extra_pos += extra_len
+
+    return bytes(patch)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build a delta firmware update')
+    parser.add_argument('source', help='image running on the device')
+    parser.add_argument('target', help='new image')
+    parser.add_argument('output', help='patch to upload')
+    args = parser.parse_args()
+
+    with open(args.source, 'rb') as f:
+        source = f.read()
+    with open(args.target, 'rb') as f:
+        target = f.read()
+
+    image_sha256(target, 'The target')
+    patch = gzip.compress(make_delta(source, target), compresslevel=9, mtime=0)
+
+    with open(args.output, 'wb') as f:
+        f.write(patch)
+
+    print(f'{len(target)} bytes image, {len(patch)} bytes patch ({100 * len(patch) / len(target):.1f}%)')
+
+
+if __name__ == '__main__':
+    main()